@@ -0,0 +1,755 @@
+#include "pch.hpp"
+#include "Level.hpp"
+#include "LevelBatch.hpp"
+#include "LevelFile.hpp"
+#include "LevelGenerator.hpp"
+#include "Minimap.hpp"
+#include "Net.hpp"
+#include "Pathfinding.hpp"
+#include "PlayerManager.hpp"
+#include "SpatialHash.hpp"
+#include "Visibility.hpp"
+#include "World.hpp"
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+
+static std::atomic<u64> allocations(0);
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+struct BenchResult
+{
+    std::string name;
+    sf::Vector2i mapSize;
+    u32 count;
+    u32 runs;
+    f64 secondsPerRun;
+    f64 itemsPerSecond;
+    f64 allocationsPerRun;
+};
+
+// `count` is the case's size parameter: room budget for generation, rooms autotiled,
+// map cells for whole-map cases and entity count for players.
+// Runs `body` until at least `minTime` has passed (and at least `minRuns` times).
+// `body` returns how many items it processed, which gives the throughput.
+static BenchResult measure(const std::string& name, const Level& level, u32 count, std::function<u64()> body,
+                           f64 minTime = 0.25, u32 minRuns = 3)
+{
+    using clock = std::chrono::steady_clock;
+
+    u64 items = 0;
+    u32 runs = 0;
+    u64 allocationsBefore = allocations.load();
+    auto start = clock::now();
+    f64 elapsed = 0;
+
+    while (runs < minRuns || elapsed < minTime) {
+        items += body();
+        runs++;
+        elapsed = std::chrono::duration<f64>(clock::now() - start).count();
+    }
+
+    u64 allocated = allocations.load() - allocationsBefore;
+    return BenchResult { name, level.mapSize, count, runs, elapsed / runs, items / elapsed, (f64)allocated / runs };
+}
+
+// Per-cell neighbor lookup the packed autotiler replaced. Kept as the reference
+// its output must match exactly.
+static TileType referenceTileType(const Bitmap& occupied, sf::Vector2i point)
+{
+    auto empty = [&](i32 dx, i32 dy) { return !occupied.get({ point.x + dx, point.y + dy }); };
+
+    i32 mask = 0;
+    if (empty(1, 0))  mask |= 1;
+    if (empty(-1, 0)) mask |= 2;
+    if (empty(0, 1))  mask |= 4;
+    if (empty(0, -1)) mask |= 8;
+
+    switch (mask) {
+        case 5:     return WALL_CORNER_DOWN_RIGHT;
+        case 6:     return WALL_CORNER_DOWN_LEFT;
+        case 9:     return WALL_CORNER_UP_RIGHT;
+        case 10:    return WALL_CORNER_UP_LEFT;
+        case 1:     return WALL_RIGHT;
+        case 2:     return WALL_LEFT;
+        case 4:     return WALL_DOWN;
+        case 8:     return WALL_UP;
+        case 0:
+            if (empty(1, 1))   return WALL_JUNCTION_DOWN_RIGHT;
+            if (empty(-1, 1))  return WALL_JUNCTION_DOWN_LEFT;
+            if (empty(1, -1))  return WALL_JUNCTION_UP_RIGHT;
+            if (empty(-1, -1)) return WALL_JUNCTION_UP_LEFT;
+            break;
+    }
+
+    return ROOM;
+}
+
+// Autotiles random bitmaps of every density and returns how many cells differ
+// from the reference classification.
+static u64 checkAutotile(u32 maps, u64& cells)
+{
+    Rng rng(0);
+    u64 mismatches = 0;
+    std::vector<Tile> tiles;
+
+    for (u32 i = 0; i < maps; i++) {
+        sf::IntRect bounds({ rng(64) - 32, rng(64) - 32 }, { 1 + rng(200), 1 + rng(60) });
+        Bitmap occupied(bounds);
+        i32 density = rng(101);
+        usize expected = 0;
+        for (i32 y = bounds.position.y; y < bounds.position.y + bounds.size.y; y++) {
+            for (i32 x = bounds.position.x; x < bounds.position.x + bounds.size.x; x++) {
+                if (rng(100) < density) {
+                    occupied.set({ x, y });
+                    expected++;
+                }
+            }
+        }
+
+        tiles.clear();
+        autotile(occupied, tiles);
+        if (tiles.size() != expected)
+            mismatches++;
+
+        for (const auto& tile: tiles) {
+            if (!occupied.get(tile.point) || tile.type != referenceTileType(occupied, tile.point))
+                mismatches++;
+        }
+        cells += tiles.size();
+    }
+
+    return mismatches;
+}
+
+static void print(const BenchResult& result)
+{
+    printf("%-14s %5dx%-5d n %-9u %8.3f ms/run %14.0f items/s %12.1f allocs/run\n",
+        result.name.c_str(), result.mapSize.x, result.mapSize.y, result.count,
+        result.secondsPerRun * 1000.0, result.itemsPerSecond, result.allocationsPerRun);
+}
+
+static void writeJson(const std::vector<BenchResult>& results, const char* path)
+{
+    FILE* file = std::fopen(path, "w");
+    if (!file) {
+        printf("Could not write %s\n", path);
+        return;
+    }
+
+    std::fprintf(file, "[\n");
+    for (usize i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        std::fprintf(file,
+            "  { \"name\": \"%s\", \"mapWidth\": %d, \"mapHeight\": %d, \"count\": %u, \"runs\": %u, "
+            "\"secondsPerRun\": %.9f, \"itemsPerSecond\": %.3f, \"allocationsPerRun\": %.3f }%s\n",
+            r.name.c_str(), r.mapSize.x, r.mapSize.y, r.count, r.runs,
+            r.secondsPerRun, r.itemsPerSecond, r.allocationsPerRun, i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "]\n");
+    std::fclose(file);
+}
+
+int main(int argc, char** argv)
+{
+    const char* output = argc > 1 ? argv[1] : "out/bench.json";
+    std::vector<BenchResult> results;
+    bool failed = false;
+
+    u64 checkedCells = 0;
+    u64 mismatches = checkAutotile(2000, checkedCells);
+    printf("autotile matches reference on %llu cells: %s\n", (unsigned long long)checkedCells, mismatches ? "NO" : "yes");
+    if (mismatches) {
+        printf("%llu autotile mismatches\n", (unsigned long long)mismatches);
+        failed = true;
+    }
+
+    for (i32 size: { 64, 256, 1024, 4096 }) {
+        for (u32 rooms: { 12u, 1024u, 32768u }) {
+            Level level({ size, size }, { 32, 16 }, { 32, 32 });
+            level.maxRooms = rooms;
+            level.maxAttempts = rooms * 16;
+
+            results.push_back(measure("generate", level, rooms, [&]() {
+                level.generate(0);
+                return (u64)size * size;
+            }));
+            print(results.back());
+
+            Rng rng(0);
+            results.push_back(measure("generateRooms", level, rooms, [&]() {
+                return (u64)level.generateRooms(rng).size();
+            }));
+            print(results.back());
+        }
+
+        // Once the level's scratch and layers have grown to fit every seed in the
+        // rotation, regenerating must not touch the heap at all.
+        {
+            Level level({ size, size }, { 32, 16 }, { 32, 32 });
+            level.maxRooms = size * size / 256;
+            level.maxAttempts = level.maxRooms * 16;
+            const u64 seeds = 8;
+            for (u64 seed = 0; seed < seeds; seed++)
+                level.generate(seed);
+
+            u64 seed = 0;
+            results.push_back(measure("regenerate", level, level.maxRooms, [&]() {
+                level.generate(seed++ % seeds);
+                return (u64)size * size;
+            }));
+            print(results.back());
+            if (results.back().allocationsPerRun > 0) {
+                printf("regenerate allocated %.3f times per run after warm-up\n", results.back().allocationsPerRun);
+                failed = true;
+            }
+
+            // The same through the background generator, whose level trades
+            // buffers with the live one on every poll.
+            LevelGenerator generator;
+            auto generateAsync = [&]() {
+                generator.request(level, seed++ % seeds);
+                while (!generator.poll(level))
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+            };
+            for (u64 i = 0; i < seeds * 2; i++)
+                generateAsync();
+
+            results.push_back(measure("generateAsync", level, level.maxRooms, [&]() {
+                generateAsync();
+                return (u64)size * size;
+            }));
+            print(results.back());
+            if (results.back().allocationsPerRun > 0) {
+                printf("generateAsync allocated %.3f times per run after warm-up\n", results.back().allocationsPerRun);
+                failed = true;
+            }
+        }
+
+        Level level({ size, size }, { 32, 16 }, { 32, 32 });
+        level.generate(0);
+
+        Rng rng(0);
+        results.push_back(measure("autotile", level, ROOM_SHAPE_COUNT, [&]() {
+            u64 tiles = 0;
+            for (u32 shape = 0; shape < ROOM_SHAPE_COUNT; shape++) {
+                Room room(level.createRoomShape({ size / 2, size / 2 }, static_cast<RoomShape>(shape), rng), rng);
+                tiles += room.tiles.size();
+            }
+            return tiles;
+        }));
+        print(results.back());
+
+        Bitmap occupied(sf::IntRect({ 0, 0 }, level.mapSize));
+        for (i32 y = 0; y < size; y++)
+            for (i32 x = 0; x < size; x++)
+                if (level.layers[1].getType({ x, y }) != EMPTY)
+                    occupied.set({ x, y });
+
+        std::vector<Tile> tiles;
+        results.push_back(measure("autotileMap", level, (u32)(size * size), [&]() {
+            tiles.clear();
+            autotile(occupied, tiles);
+            return (u64)size * size;
+        }));
+        print(results.back());
+
+        const char* snapshot = "out/bench_level.grk";
+        results.push_back(measure("saveLevel", level, (u32)(size * size), [&]() {
+            saveLevel(level, snapshot);
+            return (u64)size * size;
+        }));
+        print(results.back());
+
+        results.push_back(measure("loadLevel", level, (u32)(size * size), [&]() {
+            return (u64)loadLevel(snapshot)->layers.size() * size * size;
+        }));
+        print(results.back());
+        std::remove(snapshot);
+
+        std::vector<sf::Vertex> vertices;
+        results.push_back(measure("renderPrep", level, (u32)(size * size), [&]() {
+            const i32 chunkSize = 16;
+            u64 quads = 0;
+            for (const auto& layer: level.layers) {
+                for (i32 y = 0; y < size; y += chunkSize) {
+                    for (i32 x = 0; x < size; x += chunkSize) {
+                        vertices.clear();
+                        level.appendQuads(layer, sf::IntRect({ x, y }, { chunkSize, chunkSize }), vertices);
+                        quads += vertices.size() / 6;
+                    }
+                }
+            }
+            return quads;
+        }));
+        print(results.back());
+
+        // Toggle single room-layer tiles and regenerate only the chunk rows they
+        // dirtied, the way LevelRenderer patches them. Afterwards the locally
+        // retiled layer must match autotiling the whole map again.
+        const u32 edits = 1024;
+        results.push_back(measure("tileEdit", level, edits, [&]() {
+            const i32 chunkSize = 16;
+            for (u32 i = 0; i < edits; i++) {
+                sf::Vector2i cell(rng(size), rng(size));
+                level.dirtyCells.clear();
+                level.setTileType(1, cell, level.layers[1].getType(cell) == EMPTY ? ROOM : EMPTY);
+
+                for (const auto& change: level.dirtyCells) {
+                    sf::Vector2i start(change.cell.x / chunkSize * chunkSize, change.cell.y / chunkSize * chunkSize);
+                    vertices.clear();
+                    level.appendRow(level.layers[change.layer], sf::IntRect(start, { chunkSize, chunkSize }),
+                                    change.cell.x + change.cell.y, vertices);
+                }
+            }
+            level.dirtyCells.clear();
+            return (u64)edits;
+        }));
+        print(results.back());
+
+        occupied.clear();
+        for (i32 y = 0; y < size; y++)
+            for (i32 x = 0; x < size; x++)
+                if (level.layers[1].getType({ x, y }) != EMPTY)
+                    occupied.set({ x, y });
+
+        tiles.clear();
+        autotile(occupied, tiles);
+        u64 retileMismatches = 0;
+        for (const auto& tile: tiles) {
+            TileType type = level.layers[1].getType(tile.point);
+            if (type != tile.type && !(type >= ENTRANCE_LEFT && type <= ENTRANCE_DOWN))
+                retileMismatches++;
+        }
+        if (retileMismatches) {
+            printf("%llu cells differ from a full retile after tile edits\n", (unsigned long long)retileMismatches);
+            failed = true;
+        }
+    }
+
+    Level prototype({ 256, 256 }, { 32, 16 }, { 32, 32 });
+    prototype.maxRooms = 256;
+    prototype.maxAttempts = 4096;
+    std::vector<u64> seeds(64);
+    for (usize i = 0; i < seeds.size(); i++)
+        seeds[i] = i;
+
+    std::vector<u64> hashes;
+    for (u32 threads: { 1u, 0u }) {
+        std::vector<u64> batchHashes;
+        results.push_back(measure(threads == 1 ? "batchSerial" : "batchParallel", prototype, (u32)seeds.size(), [&]() {
+            batchHashes.clear();
+            for (const auto& level: generateBatch(prototype, seeds, threads))
+                batchHashes.push_back(level.hash());
+            return (u64)seeds.size();
+        }));
+        print(results.back());
+
+        if (hashes.empty())
+            hashes = batchHashes;
+        else if (hashes != batchHashes) {
+            printf("generateBatch output differs between thread counts\n");
+            failed = true;
+        }
+    }
+
+    for (i32 size: { 1024, 4096 }) {
+        Level level({ size, size }, { 32, 16 }, { 32, 32 });
+        level.maxRooms = size * size / 256;
+        level.maxAttempts = level.maxRooms * 16;
+        level.generate(0);
+
+        for (i32 scale: { 1, 4 }) {
+            Minimap minimap(scale);
+            for (u32 threads: { 1u, 0u }) {
+                std::string name = std::string(scale == 1 ? "minimap" : "minimapScaled") + (threads == 1 ? "Serial" : "Parallel");
+                results.push_back(measure(name, level, (u32)(size * size), [&]() {
+                    minimap.rasterize(level, threads);
+                    return (u64)size * size;
+                }));
+                print(results.back());
+            }
+        }
+
+        // Incremental updates after edits must land on what a full redraw gives.
+        Minimap minimap(4);
+        minimap.rasterize(level);
+        level.dirtyCells.clear();
+        Rng rng(size);
+        for (u32 i = 0; i < 4096; i++) {
+            sf::Vector2i cell(rng(size), rng(size));
+            level.setTileType(1, cell, rng(2) ? WALL_UP : EMPTY);
+        }
+        results.push_back(measure("minimapUpdate", level, (u32)level.dirtyCells.size(), [&]() {
+            for (const auto& change: level.dirtyCells)
+                minimap.update(level, change.cell);
+            return (u64)level.dirtyCells.size();
+        }));
+        print(results.back());
+
+        Minimap reference(4);
+        reference.rasterize(level);
+        if (minimap.types != reference.types || minimap.pixels != reference.pixels) {
+            printf("minimap after incremental updates differs from a full redraw\n");
+            failed = true;
+        }
+
+        const char* png = "out/bench_minimap.png";
+        results.push_back(measure("minimapPng", level, (u32)(minimap.size.x * minimap.size.y), [&]() {
+            return minimap.writePng(png) ? (u64)minimap.size.x * minimap.size.y : 0;
+        }));
+        print(results.back());
+        std::remove(png);
+    }
+
+    for (i32 size: { 256, 1024 }) {
+        Level level({ size, size }, { 32, 16 }, { 32, 32 });
+        level.maxRooms = size * size / 256;
+        level.maxAttempts = level.maxRooms * 16;
+        level.generate(0);
+        NavGrid grid(level);
+
+        Rng rng(0);
+        std::vector<PathQuery> queries;
+        // Fewer queries on big maps, where each one crosses many more cells.
+        while (queries.size() < (usize)(262144 / size)) {
+            sf::Vector2i start(rng(size), rng(size));
+            sf::Vector2i goal(rng(size), rng(size));
+            if (grid.isWalkable(start) && grid.isWalkable(goal))
+                queries.push_back({ start, goal });
+        }
+
+        PathScratch scratch;
+        std::vector<sf::Vector2i> path;
+        usize nextQuery = 0;
+        results.push_back(measure("astar", level, 1, [&]() {
+            const PathQuery& query = queries[nextQuery++ % queries.size()];
+            grid.findPath(query.start, query.goal, path, scratch);
+            return (u64)1;
+        }));
+        print(results.back());
+
+        std::vector<std::vector<sf::Vector2i>> paths;
+        std::vector<PathScratch> batchScratch;
+        for (u32 threads: { 1u, 0u }) {
+            results.push_back(measure(threads == 1 ? "pathBatchSerial" : "pathBatchParallel", level, (u32)queries.size(), [&]() {
+                findPaths(grid, queries, paths, batchScratch, threads);
+                return (u64)queries.size();
+            }));
+            print(results.back());
+        }
+
+        // Thousands of agents heading to the center share one field.
+        std::vector<sf::Vector2i> center { { size / 2, size / 2 } };
+        FlowField field;
+        results.push_back(measure("flowField", level, (u32)(size * size), [&]() {
+            grid.buildFlowField(center, field, scratch);
+            return (u64)size * size;
+        }));
+        print(results.back());
+
+        std::vector<sf::Vector2i> agents;
+        for (const auto& query: queries)
+            for (i32 i = 0; i < 10; i++)
+                agents.push_back(query.start);
+        results.push_back(measure("flowAgents", level, (u32)agents.size(), [&]() {
+            for (auto& agent: agents)
+                agent = field.next(agent);
+            return (u64)agents.size();
+        }));
+        print(results.back());
+    }
+
+    for (u32 count: { 10000u, 50000u }) {
+        Level level({ 256, 256 }, { 32, 16 }, { 32, 32 });
+        level.maxRooms = 256;
+        level.maxAttempts = 4096;
+        level.generate(0);
+        NavGrid grid(level);
+        SpatialHash hash(level);
+
+        Rng rng(0);
+        std::vector<sf::Vector2f> points;
+        while (points.size() < count) {
+            sf::Vector2f point = level.mapToScreen({ rng(256), rng(256) }) + sf::Vector2f(16.f, 16.f);
+            if (grid.isWalkable(hash.cellOf(point))) {
+                hash.insert(points.size(), point);
+                points.push_back(point);
+            }
+        }
+
+        u64 stuck = 0;
+        results.push_back(measure("spatialMove", level, count, [&]() {
+            for (u32 i = 0; i < count; i++) {
+                sf::Vector2f step(((f32)rng(201) - 100.f) / 50.f, ((f32)rng(201) - 100.f) / 50.f);
+                points[i] = resolveWalls(grid, hash, points[i], points[i] + step);
+                hash.move(i, points[i]);
+                stuck += !grid.isWalkable(hash.cellOf(points[i]));
+            }
+            return (u64)count;
+        }));
+        print(results.back());
+        if (stuck) {
+            printf("spatialMove walked %llu entities into walls\n", (unsigned long long)stuck);
+            failed = true;
+        }
+
+        std::vector<std::pair<u32, u32>> pairs;
+        results.push_back(measure("spatialPairs", level, count, [&]() {
+            pairs.clear();
+            hash.overlapPairs(8.f, pairs);
+            return (u64)count;
+        }));
+        print(results.back());
+
+        std::vector<u32> ids;
+        results.push_back(measure("spatialRadius", level, count, [&]() {
+            for (u32 i = 0; i < 1000; i++) {
+                ids.clear();
+                hash.queryRadius(points[i], 64.f, ids);
+            }
+            return (u64)1000;
+        }));
+        print(results.back());
+
+        // Buckets emptied by moves are swept, so overlapPairs only walks cells in use.
+        if (hash.cells.size() > 2 * hash.count + 1) {
+            printf("spatialMove left %zu buckets for %zu entities\n", hash.cells.size(), hash.count);
+            failed = true;
+        }
+    }
+
+    {
+        // A wall across map x = 32 on an open grid; moves several cells long must stop at it.
+        Level level({ 64, 64 }, { 32, 16 }, { 32, 32 });
+        NavGrid grid(level);
+        SpatialHash hash(level);
+        grid.walkable.fill(sf::IntRect({ 0, 0 }, level.mapSize));
+        for (i32 y = 0; y < 64; y++)
+            grid.walkable.set({ 32, y }, false);
+
+        sf::Vector2f offset = level.tilesetSize.componentWiseDiv({ 2, 2 }) + level.tileSize.componentWiseDiv({ 2, 2 });
+        sf::Vector2f cellStep = level.tileSize.componentWiseDiv({ 2, 2 });
+        for (i32 y = 8; y < 56; y++) {
+            sf::Vector2f from = level.mapToScreen({ 30, y }) + offset;
+            sf::Vector2f to = from + cellStep * 4.f + sf::Vector2f(cellStep.x, -cellStep.y) * 0.5f;
+            if (hash.cellOf(resolveWalls(grid, hash, from, to)).x >= 32) {
+                printf("resolveWalls moved through a wall from (%d, %d)\n", hash.cellOf(from).x, hash.cellOf(from).y);
+                failed = true;
+                break;
+            }
+        }
+    }
+
+    for (u32 count: { 1000u, 100000u }) {
+        Level level({ 256, 256 }, { 32, 16 }, { 32, 32 });
+        PlayerManager players({ 32, 48 }, 8.f);
+        Rng rng(0);
+        for (u32 i = 0; i < count; i++)
+            players.addPlayer({ (f32)rng(4096) - 2048.f, (f32)rng(4096) });
+
+        // A whole animation step per call, so every call runs the frame loop instead
+        // of only topping up the accumulator.
+        results.push_back(measure("playerUpdate", level, count, [&]() {
+            players.update(players.animationTime);
+            return (u64)count;
+        }));
+        print(results.back());
+
+        std::vector<sf::Vertex> vertices;
+        results.push_back(measure("playerQuads", level, count, [&]() {
+            vertices.clear();
+            players.appendQuads(sf::FloatRect({ -2048.f, 0.f }, { 4096.f, 4096.f }), vertices);
+            return (u64)vertices.size() / 6;
+        }));
+        print(results.back());
+    }
+
+    for (u32 count: { 1000u, 10000u }) {
+        Level level({ 1024, 1024 }, { 32, 16 }, { 32, 32 });
+        level.maxRooms = 4096;
+        level.maxAttempts = 65536;
+        level.generate(0);
+        NavGrid grid(level);
+
+        Rng rng(0);
+        std::vector<sf::Vector2i> cells;
+        while (cells.size() < count) {
+            sf::Vector2i cell(rng(1024), rng(1024));
+            if (grid.isWalkable(cell))
+                cells.push_back(cell);
+        }
+
+        // Every viewer steps to a neighbor each run, so all of them recompute;
+        // a few walls are toggled too, which dirties the viewers around them.
+        Visibility visibility(level);
+        for (u32 threads: { 1u, 0u }) {
+            results.push_back(measure(threads == 1 ? "fovSerial" : "fovParallel", level, count, [&]() {
+                for (u32 i = 0; i < count; i++) {
+                    sf::Vector2i step(rng(3) - 1, rng(3) - 1);
+                    if (grid.isWalkable(cells[i] + step))
+                        cells[i] += step;
+                    visibility.setViewer(i, cells[i], 12);
+                }
+
+                for (u32 i = 0; i < 8; i++) {
+                    sf::Vector2i cell(rng(1024), rng(1024));
+                    level.setTileType(1, cell, level.layers[1].getType(cell) == EMPTY ? ROOM : EMPTY);
+                    for (const auto& change: level.dirtyCells)
+                        visibility.tileChanged(level, change.cell);
+                    level.dirtyCells.clear();
+                }
+
+                visibility.update(threads);
+                return (u64)count;
+            }));
+            print(results.back());
+        }
+
+        // The incrementally maintained layer must match computing every viewer afresh.
+        Visibility fresh(level);
+        for (u32 i = 0; i < count; i++)
+            fresh.setViewer(i, cells[i], 12);
+        fresh.update();
+
+        u64 differences = 0;
+        for (usize i = 0; i < fresh.visible.bits.size(); i++) {
+            differences += __builtin_popcountll(fresh.visible.bits[i] ^ visibility.visible.bits[i]);
+            differences += __builtin_popcountll(visibility.visible.bits[i] & ~visibility.explored.bits[i]);
+        }
+        if (differences) {
+            printf("fov: %llu cells differ from a full recompute\n", (unsigned long long)differences);
+            failed = true;
+        }
+    }
+
+    {
+        Level level({ 256, 256 }, { 32, 16 }, { 32, 32 });
+        level.generate(0);
+        for (u32 i = 0; i < 64; i++)
+            level.setTileType(1, { (i32)(i * 37 % 256), (i32)(i * 91 % 256) }, ROOM);
+
+        // Every player steps up to a pixel per run, a few leave and join; each delta
+        // is decoded onto the previous state and must reproduce the new one.
+        const u32 count = 10000;
+        PlayerManager players({ 32, 48 }, 8.f);
+        Rng rng(0);
+        std::vector<PlayerHandle> handles;
+        for (u32 i = 0; i < count; i++)
+            handles.push_back(players.addPlayer({ (f32)rng(4096) - 2048.f, (f32)rng(4096) }));
+
+        NetSnapshot base, current, decoded;
+        captureSnapshot(players, 0, base);
+        std::vector<NetPart> parts;
+        u64 bytes = 0, mismatches = 0;
+        u32 tick = 0;
+        results.push_back(measure("netDelta", level, count, [&]() {
+            for (auto& handle: handles) {
+                if (rng(1000) == 0) {
+                    players.removePlayer(handle);
+                    handle = players.addPlayer({ (f32)rng(4096) - 2048.f, (f32)rng(4096) });
+                } else {
+                    sf::Vector2f step(((f32)rng(201) - 100.f) / 100.f, ((f32)rng(201) - 100.f) / 100.f);
+                    players.setPosition(handle, players.getPosition(handle) + step);
+                }
+            }
+            players.update(sf::seconds(1.f / 60.f));
+            captureSnapshot(players, ++tick, current);
+
+            writeDelta(&base, current, parts);
+            decoded.players = base.players;
+            for (auto& part: parts) {
+                BitReader reader(part.bits.bytes.data(), part.bits.bytes.size());
+                mismatches += !readDelta(reader, part.count, decoded);
+                bytes += part.bits.bytes.size();
+            }
+            mismatches += !sameSnapshot(decoded, current);
+            std::swap(base, current);
+            return (u64)count;
+        }));
+        print(results.back());
+
+        printf("netDelta %.2f bytes per moving player\n", (f64)bytes / ((f64)tick * count));
+        if (mismatches) {
+            printf("netDelta: %llu deltas did not reproduce the snapshot\n", (unsigned long long)mismatches);
+            failed = true;
+        }
+
+        // Both ways of shipping a level must arrive as the same tiles, edits included.
+        for (bool seeded: { true, false }) {
+            std::vector<TileChange> edits = level.dirtyCells;
+            sf::Packet packet;
+            writeLevel(packet, level, seeded, edits);
+            std::optional<Level> copy = readLevel(packet);
+            printf("netLevel %s: %zu bytes\n", seeded ? "by seed" : "by snapshot", packet.getDataSize());
+            if (!copy || copy->hash() != level.hash()) {
+                printf("netLevel: the level sent %s differs\n", seeded ? "by seed" : "by snapshot");
+                failed = true;
+            }
+        }
+    }
+
+    {
+        Level prototype({ 64, 64 }, { 32, 16 }, { 32, 32 });
+        const usize budget = 64u << 20;
+        World world(0, prototype, budget);
+        sf::FloatRect screen({ 0.f, 0.f }, { 1280.f, 800.f });
+        usize peak = 0;
+
+        // Pan a full-size view one chunk width at a time and wait until everything
+        // it wants is resident; throughput is chunks streamed in per second.
+        results.push_back(measure("worldStream", prototype, World::chunkSize * World::chunkSize, [&]() {
+            u64 before = world.chunksGenerated;
+            screen.position.x += World::chunkSize * prototype.tileSize.x;
+            world.update(screen);
+            while (world.pending()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                world.update(screen);
+            }
+            peak = std::max(peak, world.memoryUsed);
+            return world.chunksGenerated - before;
+        }));
+        print(results.back());
+
+        printf("worldStream peak %.1f MB of %.1f MB budget, %zu chunks resident\n",
+            peak / (1024.f * 1024.f), budget / (1024.f * 1024.f), world.chunks.size());
+        if (peak > budget) {
+            printf("worldStream exceeded its memory budget\n");
+            failed = true;
+        }
+
+        // A view larger than the budget keeps what it needs instead of
+        // evicting and regenerating its own chunks every frame.
+        World tight(0, prototype, 1);
+        tight.update(screen);
+        while (tight.pending()) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            tight.update(screen);
+        }
+        u64 generated = tight.chunksGenerated;
+        for (u32 i = 0; i < 8; i++)
+            tight.update(screen);
+        if (tight.chunksGenerated != generated || tight.pending()) {
+            printf("worldStream regenerates chunks the view needs when over budget\n");
+            failed = true;
+        }
+    }
+
+    writeJson(results, output);
+    printf("Wrote %s\n", output);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,6 @@
+#include "Headless.hpp"
+
+int main(int argc, char** argv)
+{
+    return runHeadless(argc - 1, argv + 1);
+}
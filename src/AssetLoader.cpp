@@ -0,0 +1,162 @@
+#include "AssetLoader.hpp"
+#include "Profiler.hpp"
+#include <chrono>
+#include <sys/stat.h>
+
+static bool sourceStamp(const std::string& path, u64& size, i64& time) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+
+    size = info.st_size;
+    time = (i64)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+    return true;
+}
+
+bool loadPixelCache(const std::string& cachePath, const std::string& source, sf::Image& image) {
+    u64 sourceSize;
+    i64 sourceTime;
+    if (!sourceStamp(source, sourceSize, sourceTime))
+        return false;
+
+    FILE* file = std::fopen(cachePath.c_str(), "rb");
+    if (!file)
+        return false;
+
+    PixelCacheHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1
+        && header.fileMagic == PixelCacheHeader::magic && header.version == PixelCacheHeader::currentVersion
+        && header.sourceSize == sourceSize && header.sourceTime == sourceTime
+        && header.width > 0 && header.height > 0 && header.width <= 16384 && header.height <= 16384;
+
+    std::vector<u8> pixels;
+    if (ok) {
+        pixels.resize((usize)header.width * header.height * 4);
+        ok = std::fread(pixels.data(), 1, pixels.size(), file) == pixels.size();
+    }
+    std::fclose(file);
+
+    if (ok)
+        image = sf::Image({ header.width, header.height }, pixels.data());
+    return ok;
+}
+
+bool savePixelCache(const std::string& cachePath, const std::string& source, const sf::Image& image) {
+    PixelCacheHeader header = {};
+    header.fileMagic = PixelCacheHeader::magic;
+    header.version = PixelCacheHeader::currentVersion;
+    header.width = image.getSize().x;
+    header.height = image.getSize().y;
+    if (!sourceStamp(source, header.sourceSize, header.sourceTime))
+        return false;
+
+    std::string temporary = cachePath + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (!file) {
+        printf("Could not open %s for writing\n", temporary.c_str());
+        return false;
+    }
+
+    usize bytes = (usize)header.width * header.height * 4;
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(image.getPixelsPtr(), 1, bytes, file) == bytes;
+
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(temporary.c_str(), cachePath.c_str()) != 0) {
+        printf("Could not write %s\n", cachePath.c_str());
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+AssetLoader::AssetLoader(const std::string& _cacheDirectory, const std::vector<Request>& _requests, u32 threads):
+    cacheDirectory(_cacheDirectory),
+    nextRequest(0),
+    uploaded(0),
+    cacheHits(0)
+{
+    for (const auto& request: _requests)
+        load(request.path, *request.texture);
+    start(threads);
+}
+
+AssetLoader::~AssetLoader() {
+    for (auto& worker: workers)
+        worker.join();
+}
+
+void AssetLoader::load(const std::string& path, sf::Texture& texture) {
+    sf::Image checker({ 8, 8 });
+    for (u32 y = 0; y < 8; y++)
+        for (u32 x = 0; x < 8; x++)
+            checker.setPixel({ x, y }, (x / 4 + y / 4) % 2 ? sf::Color(96, 96, 96) : sf::Color(160, 160, 160));
+
+    if (!texture.loadFromImage(checker))
+        printf("Could not create a placeholder for %s\n", path.c_str());
+    texture.setRepeated(true);
+    requests.push_back({ path, &texture });
+}
+
+void AssetLoader::start(u32 threads) {
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::min<u32>(threads, requests.size());
+
+    for (u32 i = 0; i < threads; i++) {
+        workers.emplace_back([this]() {
+            for (u32 next; (next = nextRequest.fetch_add(1)) < requests.size();)
+                decode(requests[next]);
+        });
+    }
+}
+
+u32 AssetLoader::poll() {
+    std::vector<DecodedImage> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.swap(finished);
+    }
+
+    u32 changed = 0;
+    for (auto& decoded: ready) {
+        uploaded++;
+        cacheHits += decoded.fromCache;
+        if (decoded.image.getSize() == sf::Vector2u() || !decoded.texture->loadFromImage(decoded.image)) {
+            printf("Could not load %s, keeping the placeholder\n", decoded.path.c_str());
+            continue;
+        }
+
+        decoded.texture->setRepeated(false);
+        changed++;
+        printf("Loaded %s in %.2f ms (%s)\n", decoded.path.c_str(), decoded.milliseconds,
+            decoded.fromCache ? "cached pixels" : "decoded");
+    }
+
+    return changed;
+}
+
+std::string AssetLoader::cachePath(const std::string& path) const {
+    usize slash = path.find_last_of('/');
+    return cacheDirectory + "/" + (slash == std::string::npos ? path : path.substr(slash + 1)) + ".pixels";
+}
+
+void AssetLoader::decode(const Request& request) {
+    PROFILE_SCOPE("AssetLoader::decode");
+    auto start = std::chrono::steady_clock::now();
+    DecodedImage result { request.texture, request.path, sf::Image(), true, 0.f };
+
+    std::string cached = cachePath(request.path);
+    if (!loadPixelCache(cached, request.path, result.image)) {
+        result.fromCache = false;
+        if (result.image.loadFromFile(request.path))
+            savePixelCache(cached, request.path, result.image);
+        else
+            result.image = sf::Image();
+    }
+
+    result.milliseconds = std::chrono::duration<f32, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    finished.push_back(std::move(result));
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "pch.hpp"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Decoded pixels of one image, kept next to the build outputs, little-endian:
+//   PixelCacheHeader
+//   u8[width * height * 4] RGBA
+// The source's size and modification time are recorded so an edited image is
+// decoded again instead of served stale.
+struct PixelCacheHeader
+{
+    static constexpr u32 magic = 0x504B5247; // "GRKP"
+    static constexpr u32 currentVersion = 1;
+
+    u32 fileMagic;
+    u32 version;
+    u32 width, height;
+    u64 sourceSize;
+    i64 sourceTime;
+};
+
+// Pixels decoded by a worker, waiting for the thread with the GL context.
+struct DecodedImage
+{
+    sf::Texture* texture;
+    std::string path;
+    sf::Image image;
+    bool fromCache;
+    f32 milliseconds;
+};
+
+// Loads textures without holding up the window. Each texture shows a checkered
+// placeholder until workers have decoded its image; poll() then uploads it on
+// the calling thread, which must own the GL context. Textures keep their
+// identity, so anything pointing at one picks up the real pixels by itself.
+struct AssetLoader
+{
+    struct Request
+    {
+        std::string path;
+        sf::Texture* texture;
+    };
+
+    std::string cacheDirectory;
+    std::vector<Request> requests;
+    std::atomic<u32> nextRequest;
+    u32 uploaded;
+    u32 cacheHits;
+
+    std::mutex mutex;
+    std::vector<DecodedImage> finished;
+    std::vector<std::thread> workers;
+
+    AssetLoader() = delete;
+    // Loads every request, starting right away so decoding overlaps whatever
+    // the caller constructs next.
+    AssetLoader(const std::string& cacheDirectory, const std::vector<Request>& requests, u32 threads = 0);
+    ~AssetLoader();
+
+    // Puts a placeholder in `texture` and queues the image for start().
+    void load(const std::string& path, sf::Texture& texture);
+    void start(u32 threads = 0);
+    // Uploads finished images. Returns how many textures changed.
+    u32 poll();
+    bool done() const { return uploaded == requests.size(); }
+
+    std::string cachePath(const std::string& path) const;
+    void decode(const Request& request);
+};
+
+// Raw pixel cache for `source`. Returns false if missing or out of date.
+bool loadPixelCache(const std::string& cachePath, const std::string& source, sf::Image& image);
+bool savePixelCache(const std::string& cachePath, const std::string& source, const sf::Image& image);
@@ -0,0 +1,98 @@
+#include "Autotile.hpp"
+
+// Neighbor words for bit i of word w: the cell to the right is bit i + 1, so
+// shifting the row down by one lines it up with the cell itself.
+static inline u64 rightOf(const u64* row, i32 w, i32 words) {
+    return (row[w] >> 1) | (w + 1 < words ? row[w + 1] << 63 : 0);
+}
+
+static inline u64 leftOf(const u64* row, i32 w) {
+    return (row[w] << 1) | (w > 0 ? row[w - 1] >> 63 : 0);
+}
+
+static void emit(u64 plane, TileType type, sf::Vector2i start, TileType* types) {
+    while (plane) {
+        i32 bit = __builtin_ctzll(plane);
+        types[start.x + bit] = type;
+        plane &= plane - 1;
+    }
+}
+
+void autotile(const Bitmap& occupied, std::vector<Tile>& tiles, std::vector<TileType>& types) {
+    types.resize(occupied.words * 64);
+
+    for (i32 y = occupied.bounds.position.y; y < occupied.bounds.position.y + occupied.bounds.size.y; y++) {
+        const u64* up = occupied.row(y - 1);
+        const u64* center = occupied.row(y);
+        const u64* down = occupied.row(y + 1);
+
+        for (i32 w = 0; w < occupied.words; w++) {
+            u64 cells = center[w];
+            if (!cells)
+                continue;
+
+            // A set bit means that neighbor is missing, like the old per-cell mask.
+            u64 right = ~rightOf(center, w, occupied.words);
+            u64 left = ~leftOf(center, w);
+            u64 below = ~down[w];
+            u64 above = ~up[w];
+
+            u64 inner = cells & ~right & ~left & ~below & ~above;
+            u64 downRight = inner & ~rightOf(down, w, occupied.words);
+            u64 downLeft = inner & ~downRight & ~leftOf(down, w);
+            u64 upRight = inner & ~downRight & ~downLeft & ~rightOf(up, w, occupied.words);
+            u64 upLeft = inner & ~downRight & ~downLeft & ~upRight & ~leftOf(up, w);
+
+            sf::Vector2i start(w * 64, 0);
+            emit(cells, ROOM, start, types.data());
+            emit(cells & right & below & ~left & ~above, WALL_CORNER_DOWN_RIGHT, start, types.data());
+            emit(cells & left & below & ~right & ~above, WALL_CORNER_DOWN_LEFT, start, types.data());
+            emit(cells & right & above & ~left & ~below, WALL_CORNER_UP_RIGHT, start, types.data());
+            emit(cells & left & above & ~right & ~below, WALL_CORNER_UP_LEFT, start, types.data());
+            emit(cells & right & ~left & ~below & ~above, WALL_RIGHT, start, types.data());
+            emit(cells & left & ~right & ~below & ~above, WALL_LEFT, start, types.data());
+            emit(cells & below & ~right & ~left & ~above, WALL_DOWN, start, types.data());
+            emit(cells & above & ~right & ~left & ~below, WALL_UP, start, types.data());
+            emit(downRight, WALL_JUNCTION_DOWN_RIGHT, start, types.data());
+            emit(downLeft, WALL_JUNCTION_DOWN_LEFT, start, types.data());
+            emit(upRight, WALL_JUNCTION_UP_RIGHT, start, types.data());
+            emit(upLeft, WALL_JUNCTION_UP_LEFT, start, types.data());
+        }
+
+        for (i32 w = 0; w < occupied.words; w++) {
+            u64 cells = center[w];
+            while (cells) {
+                i32 x = w * 64 + __builtin_ctzll(cells);
+                tiles.emplace_back(sf::Vector2i(occupied.origin.x + x, y), types[x]);
+                cells &= cells - 1;
+            }
+        }
+    }
+}
+
+void autotile(const Bitmap& occupied, std::vector<Tile>& tiles) {
+    std::vector<TileType> types;
+    autotile(occupied, tiles, types);
+}
+
+TileType classifyTile(u8 missing) {
+    switch (missing & (MISSING_RIGHT | MISSING_LEFT | MISSING_DOWN | MISSING_UP)) {
+        case MISSING_RIGHT | MISSING_DOWN:  return WALL_CORNER_DOWN_RIGHT;
+        case MISSING_LEFT | MISSING_DOWN:   return WALL_CORNER_DOWN_LEFT;
+        case MISSING_RIGHT | MISSING_UP:    return WALL_CORNER_UP_RIGHT;
+        case MISSING_LEFT | MISSING_UP:     return WALL_CORNER_UP_LEFT;
+        case MISSING_RIGHT:                 return WALL_RIGHT;
+        case MISSING_LEFT:                  return WALL_LEFT;
+        case MISSING_DOWN:                  return WALL_DOWN;
+        case MISSING_UP:                    return WALL_UP;
+        case 0:                             break;
+        default:                            return ROOM;
+    }
+
+    // Same precedence as autotile when several diagonals are open.
+    if (missing & MISSING_DOWN_RIGHT)   return WALL_JUNCTION_DOWN_RIGHT;
+    if (missing & MISSING_DOWN_LEFT)    return WALL_JUNCTION_DOWN_LEFT;
+    if (missing & MISSING_UP_RIGHT)     return WALL_JUNCTION_UP_RIGHT;
+    if (missing & MISSING_UP_LEFT)      return WALL_JUNCTION_UP_LEFT;
+    return ROOM;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Tile.hpp"
+#include "Bitmap.hpp"
+
+// Neighbors of a single cell for classifyTile; a set bit means that neighbor is empty.
+enum MissingNeighbor : u8
+{
+    MISSING_RIGHT       = 1 << 0,
+    MISSING_LEFT        = 1 << 1,
+    MISSING_DOWN        = 1 << 2,
+    MISSING_UP          = 1 << 3,
+    MISSING_DOWN_RIGHT  = 1 << 4,
+    MISSING_DOWN_LEFT   = 1 << 5,
+    MISSING_UP_RIGHT    = 1 << 6,
+    MISSING_UP_LEFT     = 1 << 7,
+};
+
+// Classifies every occupied cell of `occupied` into floor, wall, corner or junction
+// tiles, appending them to `tiles` in row-major order. `rowTypes` is scratch for one
+// row's classification, passed in so repeated calls can share it.
+void autotile(const Bitmap& occupied, std::vector<Tile>& tiles, std::vector<TileType>& rowTypes);
+void autotile(const Bitmap& occupied, std::vector<Tile>& tiles);
+
+// The tile autotile would pick for one occupied cell, for retiling a few cells in place.
+TileType classifyTile(u8 missing);
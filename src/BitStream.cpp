@@ -0,0 +1,65 @@
+#include "BitStream.hpp"
+
+void BitWriter::write(u32 value, u32 bits) {
+    if (bits < 32)
+        value &= (u32(1) << bits) - 1;
+    pending |= (u64)value << pendingBits;
+    pendingBits += bits;
+    while (pendingBits >= 8) {
+        bytes.push_back((u8)pending);
+        pending >>= 8;
+        pendingBits -= 8;
+    }
+}
+
+void BitWriter::writeVar(u32 value) {
+    while (value >= 8) {
+        write((value & 7) | 8, 4);
+        value >>= 3;
+    }
+    write(value, 4);
+}
+
+void BitWriter::flush() {
+    if (pendingBits)
+        write(0, 8 - pendingBits);
+}
+
+BitReader::BitReader(const void* _data, usize _size):
+    data(static_cast<const u8*>(_data)),
+    size(_size),
+    position(0),
+    pending(0),
+    pendingBits(0),
+    failed(false)
+{}
+
+u32 BitReader::read(u32 bits) {
+    while (pendingBits < bits) {
+        if (position == size) {
+            failed = true;
+            return 0;
+        }
+        pending |= (u64)data[position++] << pendingBits;
+        pendingBits += 8;
+    }
+
+    u32 value = bits < 32 ? (u32)pending & ((u32(1) << bits) - 1) : (u32)pending;
+    pending >>= bits;
+    pendingBits -= bits;
+    return value;
+}
+
+u32 BitReader::readVar() {
+    u32 value = 0;
+    // 11 groups of 3 bits cover 32; anything longer is garbage.
+    for (u32 shift = 0; shift < 33; shift += 3) {
+        u32 group = read(4);
+        value |= (group & 7) << shift;
+        if (!(group & 8))
+            return value;
+    }
+
+    failed = true;
+    return 0;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "pch.hpp"
+
+// Writes values of any width up to 32 bits back to back, least significant bit first.
+struct BitWriter
+{
+    std::vector<u8> bytes;
+    u64 pending = 0;
+    u32 pendingBits = 0;
+
+    void write(u32 value, u32 bits);
+    // Small values in few bits: 3 payload bits per 4-bit group, high bit continues.
+    void writeVar(u32 value);
+    void writeSigned(i32 value) { writeVar(((u32)value << 1) ^ (u32)(value >> 31)); }
+    // Pads to a whole byte; call before handing `bytes` out.
+    void flush();
+    void clear() { bytes.clear(); pending = 0; pendingBits = 0; }
+    usize size() const { return bytes.size() + (pendingBits + 7) / 8; }
+};
+
+// Reads what BitWriter wrote. Running past the end sets `failed` and yields zeros.
+struct BitReader
+{
+    const u8* data;
+    usize size;
+    usize position;
+    u64 pending;
+    u32 pendingBits;
+    bool failed;
+
+    BitReader() = delete;
+    BitReader(const void* data, usize size);
+
+    u32 read(u32 bits);
+    u32 readVar();
+    i32 readSigned() { u32 value = readVar(); return (i32)(value >> 1) ^ -(i32)(value & 1); }
+    // Skips to the next byte, where the writer's flush() left off.
+    void align() { pending = 0; pendingBits = 0; }
+    bool atEnd() const { return position == size && pendingBits == 0; }
+};
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "pch.hpp"
+
+// One bit per cell, packed into 64-bit words per row. The grid keeps an empty
+// border word row above and below and an empty bit column on each side of
+// `bounds`, so neighbor lookups at the edges never need bounds checks.
+struct Bitmap
+{
+    sf::IntRect bounds;
+    sf::Vector2i origin;
+    i32 words;
+    i32 height;
+    std::vector<u64> bits;
+
+    Bitmap(sf::IntRect _bounds):
+        bounds(_bounds),
+        origin(_bounds.position - sf::Vector2i(1, 1)),
+        words((_bounds.size.x + 2 + 63) / 64),
+        height(_bounds.size.y + 2),
+        bits((usize)words * height, 0)
+    {}
+
+    // Empties the bitmap and moves it to `bounds`, reusing the allocation when it fits.
+    void reset(sf::IntRect _bounds) {
+        bounds = _bounds;
+        origin = _bounds.position - sf::Vector2i(1, 1);
+        words = (_bounds.size.x + 2 + 63) / 64;
+        height = _bounds.size.y + 2;
+        bits.assign((usize)words * height, 0);
+    }
+
+    u64* row(i32 y) { return &bits[(usize)(y - origin.y) * words]; }
+    const u64* row(i32 y) const { return &bits[(usize)(y - origin.y) * words]; }
+
+    bool get(sf::Vector2i index) const {
+        sf::Vector2i local = index - origin;
+        if (local.x < 0 || local.y < 0 || local.x >= words * 64 || local.y >= height)
+            return false;
+        return bits[(usize)local.y * words + local.x / 64] >> (local.x % 64) & 1;
+    }
+
+    void set(sf::Vector2i index, bool value = true) {
+        sf::Vector2i local = index - origin;
+        u64& word = bits[(usize)local.y * words + local.x / 64];
+        u64 bit = u64(1) << (local.x % 64);
+        word = value ? word | bit : word & ~bit;
+    }
+
+    // Calls `apply(wordIndex, mask)` for every word touched by `rect`, clipped to the
+    // grid, stopping early once it returns true.
+    template<typename F>
+    bool forEachWord(sf::IntRect rect, F apply) const {
+        i32 left = std::max(rect.position.x - origin.x, 0);
+        i32 right = std::min(rect.position.x + rect.size.x - origin.x, words * 64);
+        i32 top = std::max(rect.position.y - origin.y, 0);
+        i32 bottom = std::min(rect.position.y + rect.size.y - origin.y, height);
+
+        for (i32 y = top; y < bottom; y++) {
+            for (i32 w = left / 64; w * 64 < right; w++) {
+                i32 start = std::max(left - w * 64, 0);
+                i32 end = std::min(right - w * 64, 64);
+                u64 mask = (end - start == 64 ? ~u64(0) : ((u64(1) << (end - start)) - 1)) << start;
+                if (apply((usize)y * words + w, mask))
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    void fill(sf::IntRect rect) {
+        forEachWord(rect, [this](usize i, u64 mask) { bits[i] |= mask; return false; });
+    }
+
+    bool any(sf::IntRect rect) const {
+        return forEachWord(rect, [this](usize i, u64 mask) { return (bits[i] & mask) != 0; });
+    }
+
+    void clear() { std::fill(bits.begin(), bits.end(), 0); }
+};
@@ -1,40 +1,194 @@
 #include "Game.hpp"
+#include "Profiler.hpp"
 
-Game::Game(u32 x, u32 y):
+static const char* tracePath = "out/trace.json";
+
+static i32 mapSizeSetting()
+{
+    const char* size = std::getenv("GROK_MAP_SIZE");
+    return size ? std::max(std::atoi(size), minMapSize) : 64;
+}
+
+static sf::Vector2i mapSizeFor(const InputReplay* replay)
+{
+    if (replay)
+        return { replay->header.mapWidth, replay->header.mapHeight };
+    return { mapSizeSetting(), mapSizeSetting() };
+}
+
+Game::Game(u32 x, u32 y, const char* levelPath, const char* replayPath):
+    startupClock(),
     window(sf::VideoMode({ x, y }), "Title"),
     view({ 0.f, 0.f }, { x / 2.f, y / 2.f }),
-    tileset("resources/tileset_isometric_pack_1bit_white.png"),
-    playerTexture("resources/Mage-Sheet.png"),
-    level({ 64, 64 }, { 32, 16 }, { 32, 32 }),
+    viewSize(x / 2.f, y / 2.f),
+    // Decoding starts here and runs while the level is generated.
+    assets("out", {
+        { "resources/tileset_isometric_pack_1bit_white.png", &tileset },
+        { "resources/Mage-Sheet.png", &playerTexture },
+    }),
+    replay(replayPath ? loadReplay(replayPath) : nullptr),
+    simulation(mapSizeFor(replay.get()), replay ? nullptr : levelPath),
+    levelRenderer(simulation.level, tileset),
+    input(window),
     pointer(tileset),
-    highlighted(nullptr)
+    frames(0),
+    firstFrameShown(false),
+    pipelined(std::getenv("GROK_PIPELINED") != nullptr)
 {
-    std::srand(0); // TODO: rng
     window.setView(view);
+    simulation.viewSize = viewSize;
+    if (replayPath && !replay)
+        window.close();
+    if (replay) {
+        // Replays step the simulation from Game::update, generating in line like the recording did.
+        pipelined = false;
+        simulation.asyncGeneration = false;
+        simulation.snapshots = false;
+        simulation.viewSize = { replay->header.viewWidth, replay->header.viewHeight };
+        if (simulation.level.seed != replay->header.seed)
+            simulation.regenerate(replay->header.seed);
+    }
+    levelRenderer.attachPlayers(simulation.playerManager, playerTexture);
+    Profiler::get().enabled = std::getenv("GROK_PROFILE") != nullptr;
+    syncRenderer();
+
+    // Fog reads the simulation's visibility directly, so only without the simulation thread.
+    if (std::getenv("GROK_FOG") && !pipelined) {
+        simulation.visibility.trackChanges = true;
+        levelRenderer.attachVisibility(&simulation.visibility);
+    }
+
+    // Stream an endless world from this seed instead of drawing the fixed level.
+    if (const char* worldSeed = std::getenv("GROK_WORLD")) {
+        world = std::make_unique<World>(std::strtoull(worldSeed, nullptr, 10), simulation.level, 128u << 20);
+        worldRenderer = std::make_unique<WorldRenderer>(*world, tileset);
+    }
 
-    level.generate(tileset);
-    playerManager.addPlayer(playerTexture, { 0, 300 }, { 32, 48 });
+    // A minimap of the fixed level, one pixel per GROK_MINIMAP x GROK_MINIMAP cells.
+    if (const char* scale = std::getenv("GROK_MINIMAP"); scale && !world) {
+        minimap = std::make_unique<Minimap>(std::atoi(scale));
+        minimap->rasterize(simulation.level);
+    }
 
-    sf::Vector2i size(level.tilesetSize);
+    sf::Vector2i size(simulation.level.tilesetSize);
     pointer.setTextureRect(sf::IntRect({ size.x * 3, size.y * 20 }, size));
 }
 
 void Game::draw()
 {
+    PROFILE_SCOPE("Game::draw");
+    sf::Clock drawClock;
+    pollAssets();
     window.clear();
 
-    window.draw(level);
-    window.draw(playerManager);
+    if (worldRenderer)
+        window.draw(*worldRenderer);
+    else
+        window.draw(levelRenderer);
     window.draw(pointer);
+    drawMinimap();
 
     window.display();
+    if (!firstFrameShown) {
+        firstFrameShown = true;
+        printf("First frame after %.1f ms\n", startupClock.getElapsedTime().asSeconds() * 1000.f);
+    }
+    Profiler::get().recordFrame(presentClock.restart().asSeconds() * 1000.f);
+    updateStats(drawClock.getElapsedTime());
+}
+
+void Game::drawMinimap()
+{
+    if (!minimap)
+        return;
+
+    sf::Vector2u size(minimap->size);
+    if (minimapTexture.getSize() != size) {
+        if (!minimapTexture.resize(size)) {
+            printf("Could not create a %ux%u minimap texture\n", size.x, size.y);
+            minimap.reset();
+            return;
+        }
+        minimap->dirtyTop = 0;
+        minimap->dirtyBottom = minimap->size.y;
+    }
+
+    // Only the changed rows go up, in one update: they are contiguous in `pixels`.
+    if (minimap->dirty()) {
+        minimapTexture.update(&minimap->pixels[(usize)minimap->dirtyTop * size.x * 4],
+            { size.x, (u32)(minimap->dirtyBottom - minimap->dirtyTop) }, { 0, (u32)minimap->dirtyTop });
+        minimap->clearDirty();
+    }
+
+    // Laid out like the level itself, a diamond with x running down-right and y
+    // down-left, fitted into the top right corner at a quarter of the window height.
+    sf::Vector2f windowSize(window.getSize());
+    sf::Vector2f half = simulation.level.tileSize / 2.f;
+    f32 fit = windowSize.y / 4.f / ((size.x + size.y) * half.y);
+    sf::Vector2f top(windowSize.x - 8.f - size.x * fit * half.x, 8.f);
+    sf::Transform transform(fit * half.x, -fit * half.x, top.x,
+                            fit * half.y, fit * half.y, top.y,
+                            0.f, 0.f, 1.f);
+
+    window.setView(window.getDefaultView());
+    window.draw(sf::Sprite(minimapTexture), transform);
+    window.setView(view);
+}
+
+void Game::pollAssets()
+{
+    if (assets.done() || assets.poll() == 0)
+        return;
+
+    // Chunk geometry only holds texture coordinates and stays valid; baked
+    // impostors hold the placeholder's pixels.
+    levelRenderer.impostors.clear();
+    if (assets.done())
+        printf("Assets ready after %.1f ms, %u of %zu from the pixel cache\n",
+            startupClock.getElapsedTime().asSeconds() * 1000.f, assets.cacheHits, assets.requests.size());
+}
+
+void Game::updateStats(sf::Time drawTime)
+{
+    frameTime += drawTime;
+    frames++;
+
+    if (frameClock.getElapsedTime() < sf::seconds(1.f))
+        return;
+
+    char title[160];
+    i32 length = std::snprintf(title, sizeof(title), "Title | %u fps | %.2f ms | %u draw calls | %u quads",
+        frames, frameTime.asSeconds() * 1000.f / frames,
+        renderStats().drawCalls / frames, renderStats().quads / frames);
+    FrameStats stats = Profiler::get().frameStats();
+    length += std::snprintf(title + length, sizeof(title) - length, " | p50 %.2f ms | p99 %.2f ms | %u missed",
+        stats.p50, stats.p99, stats.missedTicks);
+    if (simulation.generator.busy)
+        std::snprintf(title + length, sizeof(title) - length, " | generating %.0f%%",
+            simulation.generator.progress * 100.f);
+    window.setTitle(title);
+
+    renderStats().reset();
+    frameTime = sf::Time::Zero;
+    frames = 0;
+    frameClock.restart();
+}
+
+RenderStats& Game::renderStats()
+{
+    return worldRenderer ? worldRenderer->stats : levelRenderer.stats;
 }
 
 void Game::run(int framesPerSeconds)
 {
+    if (pipelined)
+        return runPipelined(framesPerSeconds);
+
     sf::Clock clock;
     sf::Time timeSinceLastUpdate;
-    sf::Time timePerFrame = sf::seconds(1.f/(float)framesPerSeconds);
+    sf::Time timePerFrame = replay ? sf::seconds(replay->header.tickSeconds) : sf::seconds(1.f/(float)framesPerSeconds);
+    if (const char* path = std::getenv("GROK_RECORD"); path && !replay)
+        startRecording(path, timePerFrame);
     
     while (window.isOpen()) {
         bool repaint = false;
@@ -45,6 +199,9 @@ void Game::run(int framesPerSeconds)
             timeSinceLastUpdate -= timePerFrame;
             repaint = true;
             update(timePerFrame);
+
+            if (timeSinceLastUpdate > timePerFrame)
+                Profiler::get().recordMissedTick();
         }
 
         if(repaint)
@@ -56,47 +213,192 @@ void Game::run(int framesPerSeconds)
 
 void Game::update(sf::Time dt)
 {
-    playerManager.update();
+    PROFILE_SCOPE("Game::update");
+    if (!replay) {
+        input.poll(inputState);
+    } else if (!pollReplay()) {
+        window.close();
+        return;
+    }
+    handleWindowActions();
 
-    f32 panSpeed = 600.f * dt.asSeconds();
-    f32 zoomSpeed = -0.1f;
-    sf::Vector2f panDirection = { 0.f, 0.f };
+    simulation.update(dt, inputState);
+    if (!simulation.running)
+        window.close();
 
-    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Scan::A)) panDirection.x = -1;
-    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Scan::D)) panDirection.x = 1;
-    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Scan::W)) panDirection.y = -1;
-    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Scan::S)) panDirection.y = 1;
-    if (panDirection != sf::Vector2f()) {
-        view.move(panDirection.normalized() * panSpeed);
-        window.setView(view);
+    if (recorder.file || replay) {
+        bool hashing = replay ? replay->header.hashes : recorder.header.hashes;
+        u64 hash = hashing ? simulation.stateHash() : 0;
+        recorder.record(inputState, hash);
+        if (replay)
+            replay->verify(hash);
     }
 
-    sf::Vector2f mousePos = window.mapPixelToCoords(sf::Mouse::getPosition(window));
-    sf::Vector2f halfTileSize = level.tilesetSize.componentWiseDiv({ 2, 2 });
-    sf::Vector2i gridPos = level.screenToMap(mousePos - halfTileSize);
-    pointer.setPosition(level.mapToScreen(gridPos));
+    syncView();
+    syncRenderer();
+    pointer.setPosition(simulation.level.mapToScreen(simulation.pointerCell));
+}
 
-    while (const std::optional event = window.pollEvent()) {
-        if (event->is<sf::Event::Closed>()) {
-            window.close();
-        } else if (const auto* keyPressed = event->getIf<sf::Event::KeyPressed>()) {
-            if (keyPressed->scancode == sf::Keyboard::Scancode::Escape) {
+void Game::startRecording(const char* path, sf::Time tickTime)
+{
+    // The level swap must land on the same tick when replayed, so generate in line.
+    simulation.asyncGeneration = false;
+    simulation.snapshots = false;
+    InputRecordingHeader header = {};
+    header.mapWidth = simulation.level.mapSize.x;
+    header.mapHeight = simulation.level.mapSize.y;
+    header.seed = simulation.level.seed;
+    header.tickSeconds = tickTime.asSeconds();
+    header.viewWidth = simulation.viewSize.x;
+    header.viewHeight = simulation.viewSize.y;
+    const char* hashes = std::getenv("GROK_RECORD_HASHES");
+    header.hashes = !hashes || std::atoi(hashes) != 0;
+    if (!simulation.levelSeeded)
+        printf("The level came from a file; a replay will start from seed %llu instead\n", (unsigned long long)header.seed);
+    if (recorder.open(path, header))
+        printf("Recording input to %s\n", path);
+}
+
+bool Game::pollReplay()
+{
+    input.poll(windowState);
+    for (const auto& event: windowState.events)
+        if (event.action == ACTION_QUIT)
+            return false;
+
+    if (replay->poll(inputState))
+        return true;
+
+    if (replay->divergedAt)
+        printf("Replay diverged from the recording at tick %llu\n", (unsigned long long)replay->divergedAt);
+    else
+        printf("Replay matched the recording: %llu ticks, %llu state hashes checked\n",
+            (unsigned long long)replay->tick, (unsigned long long)replay->checks);
+    return false;
+}
+
+void Game::handleWindowActions()
+{
+    for (const auto& event: inputState.events) {
+        if (event.action == ACTION_TOGGLE_PROFILER) {
+            Profiler::get().enabled = !Profiler::get().enabled;
+            printf("Profiling %s\n", Profiler::get().enabled ? "on" : "off");
+        } else if (event.action == ACTION_WRITE_TRACE) {
+            if (Profiler::get().writeChromeTrace(tracePath))
+                printf("Wrote %s\n", tracePath);
+        }
+    }
+}
+
+void Game::runPipelined(int ticksPerSecond)
+{
+    window.setVerticalSyncEnabled(true);
+
+    // Render-side mirror of the players, refilled from each snapshot. Built from
+    // the config only, before the simulation thread starts touching the original.
+    PlayerManager players(simulation.playerManager.frameSize, simulation.playerManager.rowHeight,
+                          simulation.playerManager.animations, simulation.playerManager.animationTime);
+    levelRenderer.attachPlayers(players, playerTexture);
+    std::shared_ptr<Level> level;
+    u64 nextEdit = 0;
+
+    {
+        SimulationThread simulationThread(simulation, sf::seconds(1.f / (float)ticksPerSecond));
+
+        while (window.isOpen()) {
+            input.poll(inputState);
+            handleWindowActions();
+            simulationThread.pushInput(inputState);
+
+            simulationThread.snapshots.update();
+            const WorldSnapshot& snapshot = simulationThread.snapshots.front();
+            if (!snapshot.running) {
                 window.close();
-            } else if (keyPressed->scancode == sf::Keyboard::Scancode::R) {
-                level.generate(tileset);
-                highlighted = nullptr;
+                break;
             }
-        } else if (const auto* scroll = event->getIf<sf::Event::MouseWheelScrolled>()) {
-            view.zoom(1.f + scroll->delta * zoomSpeed);
-            window.setView(view);
-        } else if (const auto* mouseButtonPressed = event->getIf<sf::Event::MouseButtonPressed>()) {
-            if (mouseButtonPressed->button == sf::Mouse::Button::Left) {
-                if (highlighted)
-                        highlighted->setColor(sf::Color::White);
-
-                if ((highlighted = level.getSprite(gridPos)))
-                    highlighted->setColor(sf::Color::Red);
+
+            if (snapshot.level != level) {
+                level = snapshot.level;
+                levelRenderer.setLevel(*level);
+                if (minimap)
+                    minimap->rasterize(*level);
+                nextEdit = snapshot.levelFirstEdit;
             }
+
+            u64 endEdit = snapshot.firstEdit + snapshot.edits.size();
+            for (; nextEdit < endEdit; nextEdit++) {
+                // Edits carry the final tile, already retiled by the simulation.
+                const TileEdit& edit = snapshot.edits[nextEdit - snapshot.firstEdit];
+                Layer& layer = level->layers[edit.layer];
+                layer.setType(edit.cell, edit.type);
+                layer.setFlags(edit.cell, edit.flags);
+                layer.setTint(edit.cell, edit.tint);
+                levelRenderer.markDirty({ edit.cell, edit.layer });
+                if (minimap)
+                    minimap->update(*level, edit.cell);
+            }
+            simulationThread.acknowledge(nextEdit);
+
+            // Render one tick behind the simulation, blending from the tick's start towards its end.
+            sf::Time sinceTick = simulationThread.clock.getElapsedTime() - snapshot.publishedAt;
+            f32 alpha = std::clamp(sinceTick / simulationThread.tickTime, 0.f, 1.f);
+            interpolate(snapshot, alpha, players);
+            draw();
         }
     }
+
+    // The thread has stopped; point the renderer back at the live state before
+    // the snapshot level and the mirror go out of scope.
+    levelRenderer.attachPlayers(simulation.playerManager, playerTexture);
+    levelRenderer.setLevel(simulation.level);
+}
+
+void Game::interpolate(const WorldSnapshot& snapshot, f32 alpha, PlayerManager& players)
+{
+    PROFILE_SCOPE("Game::interpolate");
+    view.setCenter(snapshot.previousCamera + (snapshot.camera - snapshot.previousCamera) * alpha);
+    view.setSize(viewSize * snapshot.zoom);
+    window.setView(view);
+    pointer.setPosition(snapshot.level->mapToScreen(snapshot.pointerCell));
+
+    if (snapshot.previousPositions.size() != snapshot.positions.size()) {
+        players.assign(snapshot.positions, snapshot.frames);
+        return;
+    }
+
+    blendedPositions.resize(snapshot.positions.size());
+    for (usize i = 0; i < snapshot.positions.size(); i++) {
+        sf::Vector2f from = snapshot.previousPositions[i];
+        blendedPositions[i] = from + (snapshot.positions[i] - from) * alpha;
+    }
+    players.assign(blendedPositions, snapshot.frames);
+}
+
+void Game::syncView()
+{
+    view.setCenter(simulation.camera);
+    view.setSize(viewSize * simulation.zoom);
+    window.setView(view);
+}
+
+void Game::syncRenderer()
+{
+    if (simulation.levelReplaced) {
+        levelRenderer.rebuild();
+        if (minimap)
+            minimap->rasterize(simulation.level);
+        simulation.levelReplaced = false;
+    }
+
+    for (const auto& change: simulation.level.dirtyCells) {
+        levelRenderer.markDirty(change);
+        if (minimap)
+            minimap->update(simulation.level, change.cell);
+    }
+    simulation.level.dirtyCells.clear();
+
+    for (const auto& cell: simulation.visibility.changedCells)
+        for (u32 layer = 0; layer < simulation.level.layers.size(); layer++)
+            levelRenderer.markDirty({ cell, layer });
+    simulation.visibility.changedCells.clear();
 }
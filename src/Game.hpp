@@ -1,26 +1,69 @@
 #pragma once
 
 #include "pch.hpp"
-#include "Level.hpp"
-#include "PlayerManager.hpp"
+#include "Simulation.hpp"
+#include "LevelRenderer.hpp"
+#include "SimulationThread.hpp"
+#include "WorldRenderer.hpp"
+#include "WindowInput.hpp"
+#include "AssetLoader.hpp"
+#include "InputRecording.hpp"
+#include "Minimap.hpp"
 
 struct Game
 {
+    // Declared first so it starts before the window opens, for startup timings.
+    sf::Clock startupClock;
     sf::RenderWindow window;
     sf::View view;
+    sf::Vector2f viewSize;
     sf::Texture tileset;
     sf::Texture playerTexture;
-    Level level;
-    PlayerManager playerManager;
+    AssetLoader assets;
+    // Set when playing a recording back; it decides the level, so it comes first.
+    std::unique_ptr<InputReplay> replay;
+    InputRecorder recorder;
+    Simulation simulation;
+    LevelRenderer levelRenderer;
+    std::unique_ptr<World> world;
+    std::unique_ptr<WorldRenderer> worldRenderer;
+    // Overview of the level in a corner of the window, when GROK_MINIMAP asks for one.
+    std::unique_ptr<Minimap> minimap;
+    sf::Texture minimapTexture;
+    WindowInput input;
+    InputState inputState;
+    // Window input while replaying, where only closing the window counts.
+    InputState windowState;
+    std::vector<sf::Vector2f> blendedPositions;
     sf::Sprite pointer;
-    sf::Sprite* highlighted;
+    sf::Clock frameClock;
+    sf::Clock presentClock;
+    sf::Time frameTime;
+    u32 frames;
+    bool firstFrameShown;
+    bool pipelined;
 
     Game() = delete;
-    Game(u32 x, u32 y);
+    Game(u32 x, u32 y, const char* levelPath = nullptr, const char* replayPath = nullptr);
 
     void run(int framesPerSeconds=60);
+    // Ticks the simulation on its own thread and renders its snapshots as fast as vsync allows.
+    void runPipelined(int ticksPerSecond);
 
     void update(sf::Time dt);
+    // Records every tick of run() to `path`, as GROK_RECORD asks.
+    void startRecording(const char* path, sf::Time tickTime);
+    // Fills inputState from the replay; false once it has ended or the window closed.
+    bool pollReplay();
+    void handleWindowActions();
+    void interpolate(const WorldSnapshot& snapshot, f32 alpha, PlayerManager& players);
     void draw();
-
+    // Uploads the minimap rows that changed and draws it over the level.
+    void drawMinimap();
+    // Uploads textures that finished loading and redraws what used their placeholders.
+    void pollAssets();
+    void updateStats(sf::Time drawTime);
+    RenderStats& renderStats();
+    void syncView();
+    void syncRenderer();
 };
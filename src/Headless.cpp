@@ -0,0 +1,324 @@
+#include "Headless.hpp"
+#include "InputRecording.hpp"
+#include "LevelBatch.hpp"
+#include "Minimap.hpp"
+#include "NetClient.hpp"
+#include "Server.hpp"
+#include "Simulation.hpp"
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+ScriptedInput::ScriptedInput(u64 seed, u64 _ticks, sf::Vector2i _mapSize, sf::Vector2f _tileSize):
+    rng(seed),
+    mapSize(_mapSize),
+    tileSize(_tileSize),
+    tick(0),
+    ticks(_ticks)
+{}
+
+bool ScriptedInput::poll(InputState& input) {
+    if (tick >= ticks)
+        return false;
+
+    input.events.clear();
+    if (tick % 120 == 0)
+        input.pan = { (f32)rng(3) - 1.f, (f32)rng(3) - 1.f };
+
+    if (tick % 30 == 0) {
+        sf::Vector2i cell(rng(mapSize.x), rng(mapSize.y));
+        input.pointer = {
+            (cell.x - cell.y) * tileSize.x / 2 + tileSize.x / 2,
+            (cell.x + cell.y) * tileSize.y / 2 + tileSize.y
+        };
+        input.events.push_back({ ACTION_SELECT, 0.f });
+    }
+
+    if (tick % 30 == 15)
+        input.events.push_back({ ACTION_TOGGLE_WALL, 0.f });
+
+    if (tick % 90 == 45)
+        input.events.push_back({ ACTION_ZOOM, rng(2) ? 1.f : -1.f });
+
+    if (tick % 600 == 599)
+        input.events.push_back({ ACTION_REGENERATE, 0.f });
+
+    tick++;
+    return true;
+}
+
+// `path` with "-<seed>" before its extension.
+static std::string seededPath(const char* path, u64 seed) {
+    std::string result(path);
+    usize dot = result.rfind('.');
+    if (dot == std::string::npos || result.find('/', dot) != std::string::npos)
+        dot = result.size();
+    return result.insert(dot, "-" + std::to_string(seed));
+}
+
+int runHeadless(int argc, char** argv) {
+    u64 ticks = 6000;
+    i32 mapSize = 64;
+    u32 players = 0;
+    u64 seed = 0;
+    f32 wander = 0.f;
+    i32 servePort = -1;
+    u32 clientCount = 0;
+    f32 bandwidth = 128 * 1024.f;
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    bool realtime = false;
+    bool hashes = true;
+    const char* minimapPath = nullptr;
+    i32 minimapScale = 1;
+    u32 minimapPool = 0;
+    bool verbose = false;
+
+    for (i32 i = 0; i + 1 < argc; i += 2) {
+        if (!std::strcmp(argv[i], "--ticks"))          ticks = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--map"))       mapSize = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--players"))   players = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--seed"))      seed = std::strtoull(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--wander"))    wander = std::atof(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--serve"))     servePort = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--clients"))   clientCount = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--bandwidth")) bandwidth = std::atof(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--record"))    recordPath = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--replay"))    replayPath = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--realtime"))  realtime = std::atoi(argv[i + 1]) != 0;
+        else if (!std::strcmp(argv[i], "--hashes"))    hashes = std::atoi(argv[i + 1]) != 0;
+        else if (!std::strcmp(argv[i], "--minimap"))   minimapPath = argv[i + 1];
+        else if (!std::strcmp(argv[i], "--minimap-scale")) minimapScale = std::atoi(argv[i + 1]);
+        else if (!std::strcmp(argv[i], "--minimap-pool"))  minimapPool = std::strtoul(argv[i + 1], nullptr, 10);
+        else if (!std::strcmp(argv[i], "--verbose"))   verbose = std::atoi(argv[i + 1]) != 0;
+        else {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (argc % 2) {
+        printf("Option %s needs a value\n", argv[argc - 1]);
+        return 1;
+    }
+
+    // A replay brings its own level and workload.
+    std::unique_ptr<InputReplay> replay;
+    sf::Time dt = sf::seconds(1.f / 60.f);
+    if (replayPath) {
+        replay = loadReplay(replayPath);
+        if (!replay)
+            return 1;
+        mapSize = replay->header.mapWidth;
+        players = replay->header.players;
+        wander = replay->header.wander;
+        seed = replay->header.workloadSeed;
+        dt = sf::seconds(replay->header.tickSeconds);
+    }
+    if (mapSize < minMapSize) {
+        printf("--map must be at least %d\n", minMapSize);
+        return 1;
+    }
+
+    Simulation simulation({ mapSize, mapSize });
+    simulation.asyncGeneration = false;
+    simulation.verbose = verbose;
+    simulation.snapshots = !replay && !recordPath;
+    if (replay) {
+        simulation.viewSize = { replay->header.viewWidth, replay->header.viewHeight };
+        if (simulation.level.seed != replay->header.seed)
+            simulation.regenerate(replay->header.seed);
+    }
+
+    Rng rng(seed);
+    std::vector<PlayerHandle> handles;
+    for (u32 i = 0; i < players; i++) {
+        sf::Vector2i cell(rng(mapSize), rng(mapSize));
+        handles.push_back(simulation.addPlayer(simulation.level.mapToScreen(cell)));
+    }
+
+    // Simulated clients share this thread with the server, so only Server::update
+    // counts as server tick time.
+    std::optional<Server> server;
+    std::vector<std::unique_ptr<NetClient>> clients;
+    if (servePort >= 0 || clientCount) {
+        server.emplace(simulation, bandwidth);
+        if (!server->listen(std::max(servePort, 0)))
+            return 1;
+
+        for (u32 i = 0; i < clientCount; i++) {
+            clients.push_back(std::make_unique<NetClient>(sf::IpAddress::LocalHost));
+            if (!clients.back()->connect(server->tcpPort()))
+                return 1;
+        }
+    }
+
+    ScriptedInput script(seed, ticks, simulation.level.mapSize, simulation.level.tileSize);
+    InputSource& input = replay ? *replay : static_cast<InputSource&>(script);
+    InputState state;
+
+    InputRecorder recorder;
+    if (recordPath) {
+        InputRecordingHeader header = {};
+        header.mapWidth = header.mapHeight = mapSize;
+        header.seed = simulation.level.seed;
+        header.tickSeconds = dt.asSeconds();
+        header.viewWidth = simulation.viewSize.x;
+        header.viewHeight = simulation.viewSize.y;
+        header.hashes = hashes;
+        header.players = players;
+        header.wander = wander;
+        header.workloadSeed = seed;
+        if (!recorder.open(recordPath, header))
+            return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::pair<u32, u32>> contacts;
+    u64 contactCount = 0;
+    ServerStats serverTotals;
+    f64 serverWorst = 0.0;
+    u64 servedTicks = 0;
+    // Real time for a server others connect to, or when asked to replay at recorded speed.
+    auto pace = [&]() {
+        if (servePort >= 0 || realtime)
+            std::this_thread::sleep_until(start + std::chrono::duration<f64>(simulation.ticks * dt.asSeconds()));
+    };
+    bool hashing = replay ? replay->header.hashes != 0 : recordPath && hashes;
+    while (simulation.running && input.poll(state)) {
+        simulation.update(dt, state);
+
+        // Random walk against the walls, plus a broad-phase contact query per tick.
+        if (wander > 0.f) {
+            for (const auto& handle: handles)
+                simulation.movePlayer(handle, { ((f32)rng(201) - 100.f) / 100.f * wander, ((f32)rng(201) - 100.f) / 100.f * wander });
+
+            contacts.clear();
+            simulation.playerHash.overlapPairs(8.f, contacts);
+            contactCount += contacts.size();
+        }
+
+        u64 hash = hashing ? simulation.stateHash() : 0;
+        recorder.record(state, hash);
+        if (replay)
+            replay->verify(hash);
+
+        if (!server) {
+            // Nothing draws the level here, so nothing else consumes its edits.
+            simulation.level.dirtyCells.clear();
+            simulation.levelReplaced = false;
+            pace();
+            continue;
+        }
+
+        server->update();
+        for (auto& client: clients)
+            client->update();
+
+        const ServerStats& tick = server->stats;
+        serverTotals.tcpBytes += tick.tcpBytes;
+        serverTotals.udpBytes += tick.udpBytes;
+        serverTotals.datagrams += tick.datagrams;
+        serverTotals.snapshotsSent += tick.snapshotsSent;
+        serverTotals.snapshotsSkipped += tick.snapshotsSkipped;
+        serverTotals.deltasEncoded += tick.deltasEncoded;
+        serverTotals.seconds += tick.seconds;
+        serverWorst = std::max(serverWorst, tick.seconds);
+        servedTicks++;
+        if (servedTicks % 600 == 0) {
+            usize connected = std::max(server->connected(), (usize)1);
+            printf("Tick %llu: %zu clients, %.0f bytes/tick (%.0f per client), server tick %.3f ms\n",
+                (unsigned long long)simulation.ticks, server->connected(), (f64)(tick.tcpBytes + tick.udpBytes),
+                (f64)(tick.tcpBytes + tick.udpBytes) / connected, tick.seconds * 1000.0);
+        }
+        pace();
+    }
+    recorder.close();
+    f64 elapsed = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%llu ticks in %.3f s: %.0f ticks/s (map %dx%d, %zu players, level hash %016llx)\n",
+        (unsigned long long)simulation.ticks, elapsed, simulation.ticks / elapsed, mapSize, mapSize,
+        simulation.playerManager.size(), (unsigned long long)simulation.level.hash());
+    if (wander > 0.f)
+        printf("%.1f player contacts per tick\n", (f64)contactCount / simulation.ticks);
+
+    u64 visibleCells = 0;
+    for (u64 word: simulation.visibility.visible.bits)
+        visibleCells += __builtin_popcountll(word);
+    printf("%.1f fields of view recomputed per tick, %llu cells visible\n",
+        (f64)simulation.visibility.recomputed / std::max<u64>(simulation.ticks, 1), (unsigned long long)visibleCells);
+
+    if (recordPath)
+        printf("Recorded %llu ticks to %s\n", (unsigned long long)recorder.ticks, recordPath);
+    if (replay) {
+        if (replay->divergedAt)
+            printf("Replay diverged from the recording at tick %llu\n", (unsigned long long)replay->divergedAt);
+        else
+            printf("Replay matched the recording: %llu ticks, %llu state hashes checked\n",
+                (unsigned long long)replay->tick, (unsigned long long)replay->checks);
+    }
+
+    if (server && servedTicks) {
+        u64 bytes = serverTotals.tcpBytes + serverTotals.udpBytes;
+        usize connected = std::max(server->connected(), (usize)1);
+        printf("Server: %zu clients, %.0f bytes/tick (%.0f per client, %.1f%% reliable), %.1f datagrams/tick\n",
+            server->connected(), (f64)bytes / servedTicks, (f64)bytes / servedTicks / connected,
+            bytes ? 100.0 * serverTotals.tcpBytes / bytes : 0.0, (f64)serverTotals.datagrams / servedTicks);
+        printf("Server tick %.3f ms average, %.3f ms worst; %.1f deltas encoded per tick, %llu of %llu snapshots held back by the %.0f bytes/s budget\n",
+            serverTotals.seconds * 1000.0 / servedTicks, serverWorst * 1000.0,
+            (f64)serverTotals.deltasEncoded / servedTicks,
+            (unsigned long long)serverTotals.snapshotsSkipped,
+            (unsigned long long)(serverTotals.snapshotsSent + serverTotals.snapshotsSkipped), bandwidth);
+    }
+
+    if (!clients.empty()) {
+        // Give clients that were mid-transfer, or held back by the budget, a second
+        // to catch up with the final tick before comparing.
+        auto behind = [&](const std::unique_ptr<NetClient>& client) { return client->latest != (u32)simulation.ticks; };
+        for (u32 round = 0; round < Server::tickRate && std::any_of(clients.begin(), clients.end(), behind); round++) {
+            server->update();
+            for (auto& client: clients)
+                client->update();
+        }
+
+        // A client is in sync when its level and newest snapshot match the server's.
+        u32 inSync = 0;
+        u64 dropped = 0;
+        u64 completed = 0;
+        u64 levelHash = simulation.level.hash();
+        for (const auto& client: clients) {
+            dropped += client->snapshotsDropped;
+            completed += client->snapshotsCompleted;
+            if (!client->ready() || client->level->hash() != levelHash)
+                continue;
+            const NetSnapshot& served = server->history[client->latest % netHistory];
+            inSync += served.tick == client->latest && sameSnapshot(served, client->snapshot());
+        }
+        printf("Clients: %u of %zu in sync, %.1f snapshots completed per client, %llu dropped\n",
+            inSync, clients.size(), (f64)completed / clients.size(), (unsigned long long)dropped);
+    }
+    if (minimapPath) {
+        Minimap minimap(minimapScale);
+        minimap.rasterize(simulation.level);
+        if (!minimap.writePng(minimapPath))
+            return 1;
+        printf("Wrote the %dx%d minimap of level %llu to %s\n", minimap.size.x, minimap.size.y,
+            (unsigned long long)simulation.level.seed, minimapPath);
+
+        // The levels of the next seeds, for looking a level pool over.
+        std::vector<u64> seeds;
+        for (u32 i = 1; i <= minimapPool; i++)
+            seeds.push_back(simulation.level.seed + i);
+        for (const auto& level: generateBatch(simulation.level, seeds)) {
+            std::string path = seededPath(minimapPath, level.seed);
+            minimap.rasterize(level);
+            if (!minimap.writePng(path.c_str()))
+                return 1;
+        }
+        if (minimapPool)
+            printf("Wrote minimaps of levels %llu to %llu\n", (unsigned long long)seeds.front(),
+                (unsigned long long)seeds.back());
+    }
+
+    return replay && replay->divergedAt ? 2 : 0;
+}
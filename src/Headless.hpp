@@ -0,0 +1,32 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Input.hpp"
+#include "Random.hpp"
+
+// Deterministic stand-in for a player: pans around, points at random cells,
+// clicks, toggles walls, zooms and regenerates on a fixed schedule derived from a seed.
+struct ScriptedInput : public InputSource
+{
+    Rng rng;
+    sf::Vector2i mapSize;
+    sf::Vector2f tileSize;
+    u64 tick;
+    u64 ticks;
+
+    ScriptedInput() = delete;
+    ScriptedInput(u64 seed, u64 ticks, sf::Vector2i mapSize, sf::Vector2f tileSize);
+
+    virtual bool poll(InputState& input);
+};
+
+// Runs the simulation without a window as fast as possible and prints ticks per second.
+// Options: --ticks N --map SIZE --players N --seed N --wander SPEED (pixels per tick)
+//          --serve PORT (0 = any; ticks in real time) --clients N (loopback clients, unthrottled)
+//          --bandwidth BYTES (per client per second)
+//          --record FILE (input and per-tick state hashes, see --hashes 0|1)
+//          --replay FILE (instead of the script; --realtime 1 keeps to the recorded tick rate)
+//          --minimap FILE (PNG of the final level, --minimap-scale N cells per pixel;
+//          --minimap-pool N also writes FILE-<seed> for the N seeds after it)
+//          --verbose 1 (print every level change)
+int runHeadless(int argc, char** argv);
@@ -0,0 +1,152 @@
+#include "ImpostorCache.hpp"
+#include "LevelRenderer.hpp"
+#include "Profiler.hpp"
+
+ImpostorCache::ImpostorCache(Level& _level, const sf::Texture& _tileset, i32 _chunkSize, usize _memoryBudget):
+    level(&_level),
+    tileset(&_tileset),
+    chunkSize(_chunkSize),
+    levels(1),
+    memoryBudget(_memoryBudget),
+    memoryUsed(0)
+{
+    reset(_level);
+}
+
+void ImpostorCache::reset(Level& _level) {
+    level = &_level;
+    clear();
+
+    // Enough levels for one block to cover the whole map.
+    levels = 1;
+    while ((chunkSize << (levels - 1)) < std::max(level->mapSize.x, level->mapSize.y))
+        levels++;
+}
+
+void ImpostorCache::clear() {
+    impostors.clear();
+    index.clear();
+    memoryUsed = 0;
+}
+
+void ImpostorCache::invalidate(sf::Vector2i chunkIndex) {
+    for (u32 lod = 0; lod < levels; lod++) {
+        auto it = index.find(key(lod, { chunkIndex.x >> lod, chunkIndex.y >> lod }));
+        if (it == index.end())
+            continue;
+
+        memoryUsed -= it->second->bytes;
+        impostors.erase(it->second);
+        index.erase(it);
+    }
+}
+
+void ImpostorCache::draw(sf::RenderTarget& target, sf::RenderStates states, const MapBounds& bounds, f32 scale,
+                         const Fog* fog, RenderStats& stats) {
+    PROFILE_SCOPE("Impostors::draw");
+    u32 lod = 0;
+    while (lod + 1 < levels && threshold / (2 << lod) >= scale)
+        lod++;
+
+    std::vector<sf::Vector2i> blocks = bounds.blocks(level->mapSize, chunkSize << lod);
+    std::stable_sort(blocks.begin(), blocks.end(), [](sf::Vector2i a, sf::Vector2i b) { return a.x + a.y < b.x + b.y; });
+
+    u32 bakes = 0;
+    drawn.clear();
+    for (const auto& block: blocks) {
+        const Impostor* impostor = find(lod, block);
+        if (!impostor && bakes < bakesPerFrame) {
+            impostor = bake(lod, block, fog);
+            bakes++;
+            stats.impostorsBaked++;
+        }
+        for (u32 parent = lod + 1; !impostor && parent < levels; parent++)
+            impostor = find(parent, { block.x >> (parent - lod), block.y >> (parent - lod) });
+
+        if (!impostor || std::find(drawn.begin(), drawn.end(), impostor->key) != drawn.end())
+            continue;
+        drawn.push_back(impostor->key);
+
+        sf::FloatRect rect = impostor->screen;
+        sf::Vector2f size(impostor->texture.getSize());
+        sf::Vertex topLeft      { rect.position,                                        sf::Color::White, { 0, 0 } };
+        sf::Vertex topRight     { rect.position + sf::Vector2f(rect.size.x, 0),         sf::Color::White, { size.x, 0 } };
+        sf::Vertex bottomLeft   { rect.position + sf::Vector2f(0, rect.size.y),         sf::Color::White, { 0, size.y } };
+        sf::Vertex bottomRight  { rect.position + rect.size,                            sf::Color::White, size };
+        sf::Vertex quad[] = { topLeft, topRight, bottomLeft, bottomLeft, topRight, bottomRight };
+
+        states.texture = &impostor->texture.getTexture();
+        target.draw(quad, 6, sf::PrimitiveType::Triangles, states);
+        stats.drawCalls++;
+        stats.quads++;
+    }
+    stats.chunksDrawn += drawn.size();
+}
+
+sf::IntRect ImpostorCache::blockCells(u32 lod, sf::Vector2i block) const {
+    i32 size = chunkSize << lod;
+    sf::Vector2i start = block * size;
+    return sf::IntRect(start, {
+        std::min(size, level->mapSize.x - start.x),
+        std::min(size, level->mapSize.y - start.y)
+    });
+}
+
+const Impostor* ImpostorCache::find(u32 lod, sf::Vector2i block) {
+    auto it = index.find(key(lod, block));
+    if (it == index.end())
+        return nullptr;
+
+    impostors.splice(impostors.begin(), impostors, it->second);
+    return &*it->second;
+}
+
+const Impostor* ImpostorCache::bake(u32 lod, sf::Vector2i block, const Fog* fog) {
+    PROFILE_SCOPE("Impostors::bake");
+    sf::IntRect cells = blockCells(lod, block);
+    sf::Vector2i end = cells.position + cells.size - sf::Vector2i(1, 1);
+
+    // The block's diamond on screen, grown by the sprites' overhang.
+    f32 left = level->mapToScreen({ cells.position.x, end.y }).x;
+    f32 right = level->mapToScreen({ end.x, cells.position.y }).x + level->tilesetSize.x;
+    f32 top = level->mapToScreen(cells.position).y;
+    f32 bottom = level->mapToScreen(end).y + level->tilesetSize.y;
+    sf::FloatRect screen({ left, top }, { right - left, bottom - top });
+
+    f32 texels = threshold / (1 << lod);
+    sf::Vector2u size((u32)std::ceil(screen.size.x * texels), (u32)std::ceil(screen.size.y * texels));
+
+    impostors.emplace_front();
+    Impostor& impostor = impostors.front();
+    if (!impostor.texture.resize(size)) {
+        printf("Could not create a %ux%u impostor\n", size.x, size.y);
+        impostors.pop_front();
+        return nullptr;
+    }
+
+    impostor.key = key(lod, block);
+    impostor.screen = screen;
+    impostor.bytes = (usize)size.x * size.y * 4;
+    impostor.texture.setSmooth(true);
+    impostor.texture.clear(sf::Color::Transparent);
+    impostor.texture.setView(sf::View(screen));
+
+    sf::RenderStates states;
+    states.texture = tileset;
+    for (const auto& layer: level->layers) {
+        vertices.clear();
+        level->appendQuads(layer, cells, vertices, nullptr, fog);
+        impostor.texture.draw(vertices.data(), vertices.size(), sf::PrimitiveType::Triangles, states);
+    }
+    impostor.texture.display();
+
+    index[impostor.key] = impostors.begin();
+    memoryUsed += impostor.bytes;
+    while (memoryUsed > memoryBudget && impostors.size() > 1) {
+        memoryUsed -= impostors.back().bytes;
+        index.erase(impostors.back().key);
+        impostors.pop_back();
+    }
+
+    return &impostor;
+}
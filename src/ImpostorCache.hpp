@@ -0,0 +1,66 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+#include <list>
+#include <unordered_map>
+
+struct RenderStats;
+
+// A block of chunks baked into one texture at reduced resolution.
+struct Impostor
+{
+    u64 key;
+    sf::FloatRect screen;
+    sf::RenderTexture texture;
+    usize bytes;
+};
+
+// Pre-rendered stand-ins for the map when zoomed out far enough that tiles are a
+// few pixels wide. Level L bakes blocks of 2^L x 2^L renderer chunks at
+// `threshold / 2^L` texels per world pixel, so whichever level matches the zoom
+// draws at about one texel per screen pixel and a whole-map view needs only a
+// few hundred blocks. Baked lazily, a few per frame, and evicted least recently
+// used beyond the memory budget. Missing blocks fall back to a cached coarser one.
+struct ImpostorCache
+{
+    // Screen pixels per world pixel below which impostors replace tiles.
+    static constexpr f32 threshold = 0.5f;
+    static constexpr u32 bakesPerFrame = 4;
+
+    using ImpostorList = std::list<Impostor>;
+
+    Level* level;
+    const sf::Texture* tileset;
+    i32 chunkSize;
+    u32 levels;
+    usize memoryBudget;
+    usize memoryUsed;
+
+    // Baked blocks, most recently drawn first.
+    ImpostorList impostors;
+    std::unordered_map<u64, ImpostorList::iterator> index;
+    std::vector<sf::Vertex> vertices;
+    std::vector<u64> drawn;
+
+    ImpostorCache() = delete;
+    ImpostorCache(Level& level, const sf::Texture& tileset, i32 chunkSize, usize memoryBudget);
+
+    // Drops every impostor; call when the level is replaced.
+    void reset(Level& level);
+    // Drops every impostor but keeps the level, e.g. after the tileset's pixels changed.
+    void clear();
+    // Drops the blocks covering a chunk whose tiles changed.
+    void invalidate(sf::Vector2i chunkIndex);
+    // Draws the blocks covering `bounds` at the level matching `scale` (screen
+    // pixels per world pixel).
+    void draw(sf::RenderTarget& target, sf::RenderStates states, const MapBounds& bounds, f32 scale,
+              const Fog* fog, RenderStats& stats);
+
+    // Map cells of a block, clipped to the map.
+    sf::IntRect blockCells(u32 lod, sf::Vector2i block) const;
+    const Impostor* find(u32 lod, sf::Vector2i block);
+    const Impostor* bake(u32 lod, sf::Vector2i block, const Fog* fog);
+
+    static u64 key(u32 lod, sf::Vector2i block) { return (u64)lod << 48 | (u64)(u32)block.y << 24 | (u32)block.x; }
+};
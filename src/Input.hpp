@@ -0,0 +1,40 @@
+#pragma once
+
+#include "pch.hpp"
+
+enum InputAction : u8
+{
+    ACTION_QUIT = 0,
+    ACTION_REGENERATE,
+    ACTION_SAVE,
+    ACTION_LOAD,
+    ACTION_SELECT,
+    ACTION_ZOOM,
+    ACTION_TOGGLE_PROFILER,
+    ACTION_WRITE_TRACE,
+    ACTION_TOGGLE_WALL,
+    ACTION_COUNT
+};
+
+struct InputEvent
+{
+    InputAction action;
+    f32 value;
+};
+
+// Everything the simulation reads from the player during one tick. The pointer
+// is already in world coordinates so the simulation never needs a window.
+struct InputState
+{
+    sf::Vector2f pan;
+    sf::Vector2f pointer;
+    std::vector<InputEvent> events;
+};
+
+struct InputSource
+{
+    virtual ~InputSource() = default;
+
+    // Fills in the input for the next tick. Returns false once the source is exhausted.
+    virtual bool poll(InputState& input) = 0;
+};
@@ -0,0 +1,198 @@
+#include "InputRecording.hpp"
+#include "Level.hpp"
+#include <cstring>
+
+enum RecordFlags : u32
+{
+    RECORD_PAN = 1,
+    RECORD_POINTER = 2,
+    RECORD_EVENTS = 4,
+    RECORD_FLAG_BITS = 3,
+};
+
+static u32 floatBits(f32 value) {
+    u32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static f32 bitsFloat(u32 bits) {
+    f32 value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+InputRecorder::InputRecorder():
+    file(nullptr),
+    header(),
+    ticks(0)
+{}
+
+InputRecorder::~InputRecorder() {
+    close();
+}
+
+bool InputRecorder::open(const char* path, const InputRecordingHeader& _header) {
+    close();
+    file = std::fopen(path, "wb");
+    if (!file) {
+        printf("Could not open %s for writing\n", path);
+        return false;
+    }
+
+    header = _header;
+    header.fileMagic = InputRecordingHeader::magic;
+    header.version = InputRecordingHeader::currentVersion;
+    if (std::fwrite(&header, sizeof(header), 1, file) != 1) {
+        printf("Could not write %s\n", path);
+        close();
+        return false;
+    }
+
+    last = InputState();
+    ticks = 0;
+    return true;
+}
+
+void InputRecorder::record(const InputState& input, u64 hash) {
+    if (!file)
+        return;
+
+    u32 flags = (input.pan != last.pan ? (u32)RECORD_PAN : 0)
+        | (input.pointer != last.pointer ? (u32)RECORD_POINTER : 0)
+        | (!input.events.empty() ? (u32)RECORD_EVENTS : 0);
+    bits.write(flags, RECORD_FLAG_BITS);
+    if (flags & RECORD_PAN) {
+        bits.write(floatBits(input.pan.x), 32);
+        bits.write(floatBits(input.pan.y), 32);
+    }
+    if (flags & RECORD_POINTER) {
+        bits.write(floatBits(input.pointer.x), 32);
+        bits.write(floatBits(input.pointer.y), 32);
+    }
+    if (flags & RECORD_EVENTS) {
+        bits.writeVar(input.events.size() - 1);
+        static_assert(ACTION_COUNT <= 16, "actions are recorded in 4 bits");
+        for (const auto& event: input.events) {
+            bits.write(event.action, 4);
+            bits.write(event.value != 0.f, 1);
+            if (event.value != 0.f)
+                bits.write(floatBits(event.value), 32);
+        }
+    }
+    if (header.hashes) {
+        bits.write((u32)hash, 32);
+        bits.write((u32)(hash >> 32), 32);
+    }
+
+    // Byte-aligned per tick, so an idle tick costs one byte.
+    bits.flush();
+    std::fwrite(bits.bytes.data(), 1, bits.bytes.size(), file);
+    bits.clear();
+
+    last.pan = input.pan;
+    last.pointer = input.pointer;
+    ticks++;
+}
+
+void InputRecorder::close() {
+    if (!file)
+        return;
+
+    if (std::fclose(file) != 0)
+        printf("Could not finish the input recording\n");
+    file = nullptr;
+}
+
+InputReplay::InputReplay(const InputRecordingHeader& _header, std::vector<u8> _data):
+    header(_header),
+    data(std::move(_data)),
+    bits(data.data(), data.size()),
+    tick(0),
+    expectedHash(0),
+    checks(0),
+    divergedAt(0)
+{}
+
+bool InputReplay::poll(InputState& input) {
+    if (bits.atEnd())
+        return false;
+
+    u32 flags = bits.read(RECORD_FLAG_BITS);
+    if (flags & RECORD_PAN) {
+        state.pan.x = bitsFloat(bits.read(32));
+        state.pan.y = bitsFloat(bits.read(32));
+    }
+    if (flags & RECORD_POINTER) {
+        state.pointer.x = bitsFloat(bits.read(32));
+        state.pointer.y = bitsFloat(bits.read(32));
+    }
+    state.events.clear();
+    if (flags & RECORD_EVENTS) {
+        u32 count = bits.readVar() + 1;
+        for (u32 i = 0; i < count && !bits.failed; i++) {
+            InputEvent event;
+            event.action = static_cast<InputAction>(bits.read(4));
+            event.value = bits.read(1) ? bitsFloat(bits.read(32)) : 0.f;
+            state.events.push_back(event);
+        }
+    }
+    if (header.hashes) {
+        expectedHash = bits.read(32);
+        expectedHash |= (u64)bits.read(32) << 32;
+    }
+    bits.align();
+
+    if (bits.failed) {
+        printf("Input recording is truncated after tick %llu\n", (unsigned long long)tick);
+        return false;
+    }
+
+    tick++;
+    input = state;
+    return true;
+}
+
+bool InputReplay::verify(u64 hash) {
+    if (!header.hashes)
+        return true;
+
+    checks++;
+    if (hash == expectedHash)
+        return true;
+
+    if (!divergedAt) {
+        divergedAt = tick;
+        printf("Replay diverged at tick %llu: state hash %016llx, recorded %016llx\n",
+            (unsigned long long)tick, (unsigned long long)hash, (unsigned long long)expectedHash);
+    }
+    return false;
+}
+
+std::unique_ptr<InputReplay> loadReplay(const char* path) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        printf("Could not open %s\n", path);
+        return nullptr;
+    }
+
+    InputRecordingHeader header;
+    std::vector<u8> data;
+    bool ok = std::fread(&header, sizeof(header), 1, file) == 1;
+    if (ok) {
+        u8 buffer[4096];
+        usize read;
+        while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+            data.insert(data.end(), buffer, buffer + read);
+        ok = !std::ferror(file);
+    }
+    std::fclose(file);
+
+    if (!ok || header.fileMagic != InputRecordingHeader::magic || header.version != InputRecordingHeader::currentVersion
+        || header.mapWidth < minMapSize || header.mapHeight < minMapSize || !(header.tickSeconds > 0.f)) {
+        printf("%s is not a compatible input recording\n", path);
+        return nullptr;
+    }
+
+    return std::make_unique<InputReplay>(header, std::move(data));
+}
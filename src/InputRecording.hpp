@@ -0,0 +1,72 @@
+#pragma once
+
+#include "pch.hpp"
+#include "BitStream.hpp"
+#include "Input.hpp"
+#include <memory>
+
+// Input recording, little-endian:
+//   InputRecordingHeader
+//   one byte-aligned, bit-packed record per tick: which of pan, pointer and events
+//   changed, their new values (floats as raw bits), then the state hash if enabled.
+// Everything else a tick depends on comes from the header, so replaying the records
+// into a fresh Simulation reproduces the run exactly.
+struct InputRecordingHeader
+{
+    static constexpr u32 magic = 0x494B5247; // "GRKI"
+    static constexpr u32 currentVersion = 1;
+
+    u32 fileMagic;
+    u32 version;
+    i32 mapWidth, mapHeight;
+    u64 seed;
+    f32 tickSeconds;
+    f32 viewWidth, viewHeight;
+    // Nonzero when every tick carries Simulation::stateHash() from after it ran.
+    u32 hashes;
+    // Headless workload on top of the input: scripted players and their random walk.
+    u32 players;
+    f32 wander;
+    u64 workloadSeed;
+};
+
+struct InputRecorder
+{
+    FILE* file;
+    InputRecordingHeader header;
+    BitWriter bits;
+    InputState last;
+    u64 ticks;
+
+    InputRecorder();
+    ~InputRecorder();
+
+    // Starts a recording at `path`; `header` needs everything but the magic and version.
+    bool open(const char* path, const InputRecordingHeader& header);
+    // Appends one tick's input and, if the header asks for them, the hash after it.
+    void record(const InputState& input, u64 hash);
+    void close();
+};
+
+// Plays a recording back as an InputSource, checking each tick's hash if it has them.
+struct InputReplay : public InputSource
+{
+    InputRecordingHeader header;
+    std::vector<u8> data;
+    BitReader bits;
+    InputState state;
+    u64 tick;
+    u64 expectedHash;
+    u64 checks;
+    // First tick whose state differed from the recording, or 0 if none did.
+    u64 divergedAt;
+
+    InputReplay() = delete;
+    InputReplay(const InputRecordingHeader& header, std::vector<u8> data);
+
+    virtual bool poll(InputState& input);
+    // Compares the state after the tick just polled with the recording.
+    bool verify(u64 hash);
+};
+
+std::unique_ptr<InputReplay> loadReplay(const char* path);
@@ -1,123 +1,223 @@
 #include "Level.hpp"
+#include "Profiler.hpp"
+
+static const sf::Color highlightTint = sf::Color::Red;
+static const sf::Color fogTint(80, 80, 112);
 
 Level::Level(sf::Vector2i _mapSize, sf::Vector2f _tileSize, sf::Vector2f _tilesetSize):
     mapSize(_mapSize),
     tileSize(_tileSize),
-    tilesetSize(_tilesetSize)
-{}
-
-void Level::draw(sf::RenderTarget& target, sf::RenderStates states) const {
-    for (const auto& layer: layers) {
-        for (u32 y = 0; y < layer.tiles.size(); y++) {
-            for (u32 x = 0; x < layer.tiles[y].size(); x++) {
-                if (layer.tiles[y][x].type == EMPTY)
-                    continue;
-
-                target.draw(layer.tiles[y][x].sprite, states);
-            }
-        }
-    }
+    tilesetSize(_tilesetSize),
+    maxRooms(12),
+    maxAttempts(200),
+    seed(0)
+{
+    buildTextureRects();
 }
 
-void Level::generate(sf::Texture& tileset) {
-    layers.clear();
-    Tile* tile = nullptr;
-    Layer groundLayer(mapSize, tileset);
+void Level::generate(u64 _seed, const GenerateProgress& progress) {
+    PROFILE_SCOPE("Level::generate");
+    seed = _seed;
+    Rng rng(seed);
+    rooms.clear();
+
+    // Regenerating refills the previous layers in place when they are owned and the
+    // right size, rather than allocating new ones.
+    auto resetLayer = [this](usize i, TileType fill) -> Layer& {
+        if (i == layers.size())
+            layers.emplace_back(mapSize);
+        else if (layers[i].size != mapSize || layers[i].types.mapped())
+            layers[i] = Layer(mapSize);
+
+        Layer& layer = layers[i];
+        std::fill(layer.types.begin(), layer.types.end(), fill);
+        layer.flags.clear();
+        layer.tints.clear();
+        return layer;
+    };
+    if (layers.size() > 2)
+        layers.erase(layers.begin() + 2, layers.end());
 
     sf::Vector2i centerSize({ mapSize.x / 4 + 1, mapSize.y / 4 + 1 });
     center = sf::IntRect({ mapSize.x / 2 - centerSize.x + 1, mapSize.y / 2 - centerSize.y + 1 }, centerSize);
 
+    Layer& groundLayer = resetLayer(0, SPACE);
     for (i32 y = center.position.y; y < center.position.y + center.size.y; y++)
         for (i32 x = center.position.x; x < center.position.x + center.size.x; x++)
-            groundLayer.tiles[y][x].type = CENTER;
+            groundLayer.setType({ x, y }, CENTER);
 
-    for (i32 y = 0; y < mapSize.y; y++) {
-        for (i32 x = 0; x < mapSize.x; x++) {
-            tile = &groundLayer.tiles[y][x];
-            if (tile->type == EMPTY)
-                tile->type = SPACE;
+    if (progress)
+        progress(0.1f);
 
-            tile->sprite.setPosition(mapToScreen({ x, y }));
-            tile->sprite.setTextureRect(determineTextureRect(tile->type));
-        }
+    Layer& roomLayer = resetLayer(1, EMPTY);
+    placeRooms(rng, progress);
+    rooms.insert(rooms.end(), scratch.rooms.begin(), scratch.rooms.end());
+    for (const auto& tile: scratch.tiles)
+        roomLayer.setType(tile.point, tile.type);
+
+    if (progress)
+        progress(1.f);
+}
+
+// Cell of each tile type in the tileset, in units of one tile sprite.
+static const sf::Vector2i atlasCells[TILE_TYPE_COUNT] = {
+    { 2, 23 },  // EMPTY
+    { 3, 0 },   // SPACE
+    { 8, 0 },   // CENTER
+    { 0, 0 },   // ROOM
+    { 3, 3 },   // WALL_LEFT
+    { 0, 3 },   // WALL_RIGHT
+    { 1, 3 },   // WALL_UP
+    { 2, 3 },   // WALL_DOWN
+    { 6, 10 },  // WALL_CORNER_DOWN_LEFT
+    { 4, 10 },  // WALL_CORNER_DOWN_RIGHT
+    { 7, 10 },  // WALL_CORNER_UP_LEFT
+    { 5, 10 },  // WALL_CORNER_UP_RIGHT
+    { 1, 4 },   // WALL_JUNCTION_DOWN_RIGHT
+    { 2, 4 },   // WALL_JUNCTION_DOWN_LEFT
+    { 0, 4 },   // WALL_JUNCTION_UP_RIGHT
+    { 3, 4 },   // WALL_JUNCTION_UP_LEFT
+    { 10, 7 },  // ENTRANCE_LEFT
+    { 10, 1 },  // ENTRANCE_RIGHT
+    { 11, 7 },  // ENTRANCE_UP
+    { 11, 1 },  // ENTRANCE_DOWN
+};
+
+void Level::buildTextureRects() {
+    for (u32 type = 0; type < TILE_TYPE_COUNT; type++)
+        textureRects[type] = sf::FloatRect(sf::Vector2f(atlasCells[type]).componentWiseMul(tilesetSize), tilesetSize);
+}
+
+void Level::appendQuads(const Layer& layer, sf::IntRect area, std::vector<sf::Vertex>& vertices,
+                        std::vector<u32>* depthStarts, const Fog* fog) {
+    sf::Vector2i end = area.position + area.size - sf::Vector2i(1, 1);
+
+    // Walk the area one isometric row (x + y) at a time, back to front, so tiles
+    // come out already in draw order and each row is a contiguous vertex range.
+    for (i32 depth = area.position.x + area.position.y; depth <= end.x + end.y; depth++) {
+        if (depthStarts)
+            depthStarts->push_back(vertices.size());
+        appendRow(layer, area, depth, vertices, fog);
     }
-    layers.push_back(groundLayer);
-
-    Layer roomLayer(mapSize, tileset);
-    std::vector<Room> rooms = generateRooms(tileset);
-    for (const auto& room: rooms)
-        for (const auto& tile: room.tiles)
-            roomLayer.tiles[tile.point.y][tile.point.x] = tile;
-
-    for (i32 y = 0; y < mapSize.y; y++) {
-        for (i32 x = 0; x < mapSize.x; x++) {
-            tile = &roomLayer.tiles[y][x];
-            tile->sprite.setPosition(mapToScreen({ x, y }));
-            tile->sprite.setTextureRect(determineTextureRect(tile->type));
-        }
+
+    if (depthStarts)
+        depthStarts->push_back(vertices.size());
+}
+
+void Level::appendRow(const Layer& layer, sf::IntRect area, i32 depth, std::vector<sf::Vertex>& vertices,
+                      const Fog* fog) {
+    sf::Vector2f size = tilesetSize;
+    sf::Vector2i end = area.position + area.size - sf::Vector2i(1, 1);
+
+    for (i32 x = std::max(area.position.x, depth - end.y); x <= std::min(end.x, depth - area.position.y); x++) {
+        i32 y = depth - x;
+        TileType type = layer.getType({ x, y });
+        if (type == EMPTY || (fog && !fog->explored.get({ x, y })))
+            continue;
+
+        sf::Vector2f pos = mapToScreen({ x, y });
+        const sf::FloatRect& rect = textureRect(type);
+        sf::Color color = layer.getFlags({ x, y }) & TILE_HIGHLIGHTED ? highlightTint : layer.getTint({ x, y });
+        if (fog && !fog->visible.get({ x, y }))
+            color *= fogTint;
+
+        sf::Vertex topLeft      { pos,                          color, rect.position };
+        sf::Vertex topRight     { pos + sf::Vector2f(size.x, 0), color, rect.position + sf::Vector2f(rect.size.x, 0) };
+        sf::Vertex bottomLeft   { pos + sf::Vector2f(0, size.y), color, rect.position + sf::Vector2f(0, rect.size.y) };
+        sf::Vertex bottomRight  { pos + size,                   color, rect.position + rect.size };
+
+        vertices.insert(vertices.end(), { topLeft, topRight, bottomLeft, bottomLeft, topRight, bottomRight });
+    }
+}
+
+RoomInfo buildRoom(const RoomRects& rects, Rng& rng, std::vector<Tile>& tiles, RoomScratch& scratch) {
+    RoomInfo info;
+    sf::IntRect bounds = rects.front();
+    for (const auto& rect: rects)
+        bounds = boundingRect(bounds, rect);
+    info.bounds = bounds;
+
+    scratch.points.reset(bounds);
+    for (const auto& rect: rects)
+        scratch.points.fill(rect);
+
+    usize first = tiles.size();
+    autotile(scratch.points, tiles, scratch.rowTypes);
+
+    scratch.straightWalls.clear();
+    for (usize i = first; i < tiles.size(); i++) {
+        TileType type = tiles[i].type;
+        if (type == WALL_LEFT || type == WALL_RIGHT || type == WALL_UP || type == WALL_DOWN)
+            scratch.straightWalls.push_back(i);
     }
 
-    layers.push_back(roomLayer);
-}
-
-sf::IntRect Level::determineTextureRect(TileType type) {
-    sf::Vector2i size(tilesetSize);
-
-    switch (type) {
-        case EMPTY:                     return sf::IntRect({ size.x * 2, size.y * 23 }, size);
-        case SPACE:                     return sf::IntRect({ size.x * 3, size.y * 0 }, size);
-        case CENTER:                    return sf::IntRect({ size.x * 8, size.y * 0 }, size);
-        case ROOM:                      return sf::IntRect({ size.x * 0, size.y * 0 }, size);
-        case WALL_LEFT:                 return sf::IntRect({ size.x * 3, size.y * 3 }, size);
-        case WALL_RIGHT:                return sf::IntRect({ size.x * 0, size.y * 3 }, size);
-        case WALL_UP:                   return sf::IntRect({ size.x * 1, size.y * 3 }, size);
-        case WALL_DOWN:                 return sf::IntRect({ size.x * 2, size.y * 3 }, size);
-        case WALL_CORNER_DOWN_LEFT:     return sf::IntRect({ size.x * 6, size.y * 10 }, size);
-        case WALL_CORNER_DOWN_RIGHT:    return sf::IntRect({ size.x * 4, size.y * 10 }, size);
-        case WALL_CORNER_UP_LEFT:       return sf::IntRect({ size.x * 7, size.y * 10 }, size);
-        case WALL_CORNER_UP_RIGHT:      return sf::IntRect({ size.x * 5, size.y * 10 }, size);
-        case WALL_JUNCTION_DOWN_RIGHT:  return sf::IntRect({ size.x * 1, size.y * 4 }, size);
-        case WALL_JUNCTION_DOWN_LEFT:   return sf::IntRect({ size.x * 2, size.y * 4 }, size);
-        case WALL_JUNCTION_UP_RIGHT:    return sf::IntRect({ size.x * 0, size.y * 4 }, size);
-        case WALL_JUNCTION_UP_LEFT:     return sf::IntRect({ size.x * 3, size.y * 4 }, size);
-        case ENTRANCE_LEFT:             return sf::IntRect({ size.x * 10, size.y * 7 }, size);
-        case ENTRANCE_RIGHT:            return sf::IntRect({ size.x * 10, size.y * 1 }, size);
-        case ENTRANCE_UP:               return sf::IntRect({ size.x * 11, size.y * 7 }, size);
-        case ENTRANCE_DOWN:             return sf::IntRect({ size.x * 11, size.y * 1 }, size);
-        default:                        return sf::IntRect({ size.x * 2, size.y * 23 }, size);
+    Tile* entrance = &tiles[scratch.straightWalls[rng(scratch.straightWalls.size())]];
+    info.entrance = entrance->point;
+    switch (entrance->type) {
+        case WALL_LEFT:     entrance->type = ENTRANCE_LEFT;     break;
+        case WALL_RIGHT:    entrance->type = ENTRANCE_RIGHT;    break;
+        case WALL_UP:       entrance->type = ENTRANCE_UP;       break;
+        case WALL_DOWN:     entrance->type = ENTRANCE_DOWN;     break;
+        default:                                                break;
     }
+
+    return info;
 }
 
-std::vector<Room> Level::generateRooms(sf::Texture &tileset) {
-    std::vector<Room> rooms;
-    std::vector<sf::IntRect> rects;
+void Level::placeRooms(Rng& rng, const GenerateProgress& progress) {
+    scratch.rooms.clear();
+    scratch.tiles.clear();
+    scratch.roomEnds.clear();
+
+    // Every placed rect is stored grown by the required margin, so a candidate only
+    // has to check its own cells instead of every other room.
+    Bitmap& occupied = scratch.occupied;
+    occupied.reset(sf::IntRect({ 0, 0 }, mapSize));
+    occupied.fill(withMargin(center));
+
+    u32 attempts = 0;
+    while (attempts++ < maxAttempts && scratch.rooms.size() < maxRooms) {
+        if (progress && attempts % 1024 == 0)
+            progress(0.1f + 0.8f * std::max((f32)attempts / maxAttempts, (f32)scratch.rooms.size() / maxRooms));
 
-    i32 maxAttempts = 200;
-    i32 attempts = 0;
-    while (attempts++ < maxAttempts && rooms.size() < 12) {
         sf::Vector2i pos({
-            1 + (rand() % mapSize.x),
-            1 + (rand() % mapSize.y)
+            1 + (rng(mapSize.x)),
+            1 + (rng(mapSize.y))
         });
-        RoomShape shape = static_cast<RoomShape>(rand() % ROOM_SHAPE_COUNT);
-
-        auto roomRects = createRoomShape(pos, shape);
-        if (roomCanBePlaced(roomRects, rects)) {
-            rooms.emplace_back(roomRects, tileset);
-            rects.insert(rects.end(), roomRects.begin(), roomRects.end());
+        RoomShape shape = static_cast<RoomShape>(rng(ROOM_SHAPE_COUNT));
+
+        RoomRects roomRects = createRoomShape(pos, shape, rng);
+        if (roomCanBePlaced(roomRects, occupied)) {
+            scratch.rooms.push_back(buildRoom(roomRects, rng, scratch.tiles, scratch.room));
+            scratch.roomEnds.push_back(scratch.tiles.size());
+            for (const auto& rect: roomRects)
+                occupied.fill(withMargin(rect));
         }
     }
+}
+
+std::vector<Room> Level::generateRooms(Rng& rng, const GenerateProgress& progress) {
+    placeRooms(rng, progress);
+
+    std::vector<Room> result;
+    result.reserve(scratch.rooms.size());
+    u32 start = 0;
+    for (usize i = 0; i < scratch.rooms.size(); i++) {
+        auto begin = scratch.tiles.begin();
+        result.emplace_back(scratch.rooms[i], std::vector<Tile>(begin + start, begin + scratch.roomEnds[i]));
+        start = scratch.roomEnds[i];
+    }
 
-    return rooms;
+    return result;
 }
 
-std::vector<sf::IntRect> Level::createRoomShape(const sf::Vector2i& pos, RoomShape shape) {
+RoomRects Level::createRoomShape(const sf::Vector2i& pos, RoomShape shape, Rng& rng) {
     switch (shape) {
         case L_SHAPE: {
             sf::Vector2i baseSize(5, 9);
             sf::Vector2i flippedSize(baseSize.y, baseSize.x);
             sf::IntRect top, bottom;
-            switch (rand() % 4)
+            switch (rng(4))
             {
                 case 0: // normal L
                     top = sf::IntRect(pos, baseSize);
@@ -137,14 +237,14 @@ std::vector<sf::IntRect> Level::createRoomShape(const sf::Vector2i& pos, RoomSha
                     break;
             }
 
-            return std::vector<sf::IntRect>({ top, bottom });
+            return RoomRects{ { top, bottom }, 2 };
         }
 
         case T_SHAPE: {
             sf::Vector2i baseSize(9, 5);
             sf::Vector2i flippedSize(baseSize.y, baseSize.x);
             sf::IntRect top, bottom;
-            switch (rand() % 4)
+            switch (rng(4))
             {
                 case 0: // normal T
                     top = sf::IntRect(pos, baseSize);
@@ -164,49 +264,122 @@ std::vector<sf::IntRect> Level::createRoomShape(const sf::Vector2i& pos, RoomSha
                     break;
             }
 
-            return std::vector<sf::IntRect>({ top, bottom });
+            return RoomRects{ { top, bottom }, 2 };
         }
 
         case RECTANGLE: {
             sf::Vector2i baseSize(13, 7);
             sf::Vector2i flippedSize(baseSize.y, baseSize.x);
-            sf::IntRect rect(pos, rand() % 2 == 1 ? baseSize : flippedSize);
-            return std::vector<sf::IntRect>({ rect });
+            sf::IntRect rect(pos, rng(2) == 1 ? baseSize : flippedSize);
+            return RoomRects{ { rect }, 1 };
         }
 
         case ROOM_SHAPE_COUNT: break;
     }
 
-    return std::vector<sf::IntRect>();
+    return RoomRects();
 }
 
-bool Level::roomCanBePlaced(std::vector<sf::IntRect>& rects, std::vector<sf::IntRect>& others) {
+bool Level::roomCanBePlaced(const RoomRects& rects, const Bitmap& occupied) {
     for (const auto& rect : rects) {
         if (outOfBounds(rect))
             return false;
 
-        sf::IntRect oversized({ rect.position.x - 2, rect.position.y - 2 }, { rect.size.x + 4, rect.size.y + 4 });
-        if (oversized.findIntersection(center) != std::nullopt)
+        if (occupied.any(rect))
             return false;
-
-        for(const auto& other: others)
-            if (oversized.findIntersection(other) != std::nullopt)
-                return false;
     }
 
     return true;
 }
 
-sf::Sprite* Level::getSprite(sf::Vector2i index) {
-    sf::Vector2i adjusted({ index.x + 1, index.y + 1 });
-    if (outOfBounds(adjusted))
-        return nullptr;
+void Level::setTileType(u32 layer, sf::Vector2i index, TileType type, bool retileNeighbors) {
+    if (layer >= layers.size() || !contains(index))
+        return;
+
+    TileType old = layers[layer].getType(index);
+    if (old != type) {
+        layers[layer].setType(index, type);
+        dirtyCells.push_back({ index, layer });
+    }
+
+    // Only a change in occupancy can reshape the walls around the cell.
+    if (!retileNeighbors || layer == 0 || (old == EMPTY) == (type == EMPTY))
+        return;
+
+    for (i32 y = index.y - 1; y <= index.y + 1; y++)
+        for (i32 x = index.x - 1; x <= index.x + 1; x++)
+            retile(layer, { x, y });
+}
+
+void Level::setTileTint(u32 layer, sf::Vector2i index, sf::Color tint) {
+    if (layer >= layers.size() || !contains(index) || layers[layer].getTint(index) == tint)
+        return;
+
+    layers[layer].setTint(index, tint);
+    dirtyCells.push_back({ index, layer });
+}
+
+void Level::setTileFlags(u32 layer, sf::Vector2i index, u8 flags) {
+    if (layer >= layers.size() || !contains(index) || layers[layer].getFlags(index) == flags)
+        return;
+
+    layers[layer].setFlags(index, flags);
+    dirtyCells.push_back({ index, layer });
+}
+
+void Level::retile(u32 layer, sf::Vector2i index) {
+    if (layer >= layers.size() || !contains(index))
+        return;
+
+    const Layer& tiles = layers[layer];
+    TileType type = tiles.getType(index);
+    if (type == EMPTY || (type >= ENTRANCE_LEFT && type <= ENTRANCE_DOWN))
+        return;
+
+    auto empty = [&](i32 dx, i32 dy) {
+        sf::Vector2i neighbor(index.x + dx, index.y + dy);
+        return !contains(neighbor) || tiles.getType(neighbor) == EMPTY;
+    };
+
+    u8 missing = (empty(1, 0) ? MISSING_RIGHT : 0) | (empty(-1, 0) ? MISSING_LEFT : 0)
+        | (empty(0, 1) ? MISSING_DOWN : 0) | (empty(0, -1) ? MISSING_UP : 0)
+        | (empty(1, 1) ? MISSING_DOWN_RIGHT : 0) | (empty(-1, 1) ? MISSING_DOWN_LEFT : 0)
+        | (empty(1, -1) ? MISSING_UP_RIGHT : 0) | (empty(-1, -1) ? MISSING_UP_LEFT : 0);
+
+    setTileType(layer, index, classifyTile(missing), false);
+}
+
+i32 Level::topLayer(sf::Vector2i index) const {
+    if (!contains(index))
+        return -1;
 
     for (i32 i = layers.size() - 1; i >= 0; i--)
-        if (layers[i].tiles[adjusted.y][adjusted.x].type != EMPTY)
-            return &layers[i].tiles[adjusted.y][adjusted.x].sprite;
+        if (layers[i].getType(index) != EMPTY)
+            return i;
 
-    return nullptr;
+    return -1;
+}
+
+u64 Level::hash() const {
+    // FNV-1a over every layer's tile types.
+    u64 hash = 0xCBF29CE484222325ull;
+    for (const auto& layer: layers) {
+        for (u8 type: layer.types) {
+            hash ^= type;
+            hash *= 0x100000001B3ull;
+        }
+    }
+
+    return hash;
+}
+
+usize Level::memoryUsage() const {
+    usize bytes = sizeof(Level) + layers.capacity() * sizeof(Layer) + rooms.capacity() * sizeof(RoomInfo)
+        + scratch.memoryUsage();
+    for (const auto& layer: layers)
+        bytes += layer.memoryUsage();
+
+    return bytes;
 }
 
 bool Level::outOfBounds(sf::Vector2i index) {
@@ -220,6 +393,10 @@ bool Level::outOfBounds(sf::IntRect rect) {
         || rect.position.y + rect.size.y >= mapSize.y - 1;
 }
 
+sf::IntRect Level::withMargin(sf::IntRect rect) {
+    return sf::IntRect({ rect.position.x - 2, rect.position.y - 2 }, { rect.size.x + 4, rect.size.y + 4 });
+}
+
 sf::Vector2f Level::mapToScreen(sf::Vector2i index) {
     return sf::Vector2f(
         (index.x - index.y) * tileSize.x / 2,
@@ -233,3 +410,39 @@ sf::Vector2i Level::screenToMap(sf::Vector2f point) {
         (point.y / tileSize.y - point.x / tileSize.x)
     );
 }
+
+std::vector<sf::Vector2i> MapBounds::blocks(sf::Vector2i mapSize, i32 blockSize) const {
+    std::vector<sf::Vector2i> visible;
+    sf::Vector2i range = rows();
+    i32 firstRow = std::max(range.x, 0) / blockSize;
+    i32 lastRow = std::min(range.y, mapSize.y - 1) / blockSize;
+
+    for (i32 by = firstRow; range.x <= range.y && by <= lastRow; by++) {
+        sf::Vector2i span = columns(by * blockSize, by * blockSize + blockSize - 1);
+        if (span.x > span.y)
+            continue;
+
+        i32 firstColumn = std::max(span.x, 0) / blockSize;
+        i32 lastColumn = std::min(span.y, mapSize.x - 1) / blockSize;
+        for (i32 bx = firstColumn; bx <= lastColumn; bx++) {
+            sf::IntRect rect({ bx * blockSize, by * blockSize }, { blockSize, blockSize });
+            if (intersects(rect))
+                visible.emplace_back(bx, by);
+        }
+    }
+
+    return visible;
+}
+
+MapBounds Level::visibleBounds(sf::FloatRect screen) {
+    // A tile at index covers [mapToScreen(index), mapToScreen(index) + tilesetSize],
+    // so invert mapToScreen on the view edges widened by one sprite.
+    sf::Vector2f halfTile = tileSize.componentWiseDiv({ 2, 2 });
+    sf::Vector2f start = (screen.position - tilesetSize).componentWiseDiv(halfTile);
+    sf::Vector2f end = (screen.position + screen.size).componentWiseDiv(halfTile);
+
+    return MapBounds {
+        (i32)std::floor(start.x), (i32)std::ceil(end.x),
+        (i32)std::floor(start.y), (i32)std::ceil(end.y)
+    };
+}
@@ -2,30 +2,13 @@
 
 #include "pch.hpp"
 #include "helpers.hpp"
-
-enum TileType
-{
-    EMPTY = 0,
-    SPACE,
-    CENTER,
-    ROOM,
-    WALL_LEFT,
-    WALL_RIGHT,
-    WALL_UP,
-    WALL_DOWN,
-    WALL_CORNER_DOWN_LEFT,
-    WALL_CORNER_DOWN_RIGHT,
-    WALL_CORNER_UP_LEFT,
-    WALL_CORNER_UP_RIGHT,
-    WALL_JUNCTION_DOWN_RIGHT,
-    WALL_JUNCTION_DOWN_LEFT,
-    WALL_JUNCTION_UP_RIGHT,
-    WALL_JUNCTION_UP_LEFT,
-    ENTRANCE_LEFT,
-    ENTRANCE_RIGHT,
-    ENTRANCE_UP,
-    ENTRANCE_DOWN,
-};
+#include "Tile.hpp"
+#include "Bitmap.hpp"
+#include "Autotile.hpp"
+#include "Random.hpp"
+#include "TileBuffer.hpp"
+#include <array>
+#include <unordered_map>
 
 enum RoomShape
 {
@@ -35,141 +18,251 @@ enum RoomShape
     ROOM_SHAPE_COUNT
 };
 
-struct VectorHash {
-    std::size_t operator()(const sf::Vector2i& vec) const {
-        return std::hash<int>()(vec.x) ^ std::hash<int>()(vec.y);
+// What a level remembers about each room once its tiles are in the room layer.
+struct RoomInfo
+{
+    sf::IntRect bounds;
+    sf::Vector2i entrance;
+};
+
+// The one or two rects of a room shape, held inline so trying a candidate room
+// allocates nothing.
+struct RoomRects
+{
+    std::array<sf::IntRect, 2> rects;
+    u32 count = 0;
+
+    const sf::IntRect* begin() const { return rects.data(); }
+    const sf::IntRect* end() const { return rects.data() + count; }
+    const sf::IntRect& front() const { return rects[0]; }
+};
+
+// Working memory for building rooms. It only ever grows, so once it has held the
+// largest room, building another allocates nothing.
+struct RoomScratch
+{
+    Bitmap points;
+    std::vector<u32> straightWalls;
+    std::vector<TileType> rowTypes;
+
+    RoomScratch(): points(sf::IntRect()) {}
+};
+
+// Autotiles the union of `rects`, appending the tiles to `tiles`, and turns one of
+// its straight walls into the entrance.
+RoomInfo buildRoom(const RoomRects& rects, Rng& rng, std::vector<Tile>& tiles, RoomScratch& scratch);
+
+struct Room
+{
+    std::vector<Tile> tiles;
+    RoomInfo info;
+
+    Room(const RoomRects& rects, Rng& rng) {
+        RoomScratch scratch;
+        info = buildRoom(rects, rng, tiles, scratch);
     }
+
+    Room(const RoomInfo& _info, std::vector<Tile> _tiles):
+        tiles(std::move(_tiles)),
+        info(_info)
+    {}
 };
 
-struct Tile
+// One contiguous grid per layer. Screen positions and texture rects are derived
+// from the index and type when drawing. Tints and flags are rare, so they are kept
+// sparse, keyed by cell offset, and cells at the default value are not stored.
+struct Layer
 {
-    sf::Sprite sprite;
-    sf::Vector2i point;
-    TileType type;
+    sf::Vector2i size;
+    TileBuffer types;
+    std::unordered_map<u32, u8> flags;
+    std::unordered_map<u32, sf::Color> tints;
 
-    Tile(sf::Texture &tileset):
-        sprite(tileset),
-        type(EMPTY)
+    Layer(sf::Vector2i mapSize):
+        size(mapSize),
+        types(mapSize.x * mapSize.y, EMPTY)
     {}
 
-    Tile(sf::Texture &tileset, sf::Vector2i _point, TileType _type):
-        sprite(tileset),
-        point(_point),
-        type(_type)
+    Layer(sf::Vector2i mapSize, TileBuffer _types):
+        size(mapSize),
+        types(std::move(_types))
     {}
+
+    usize offset(sf::Vector2i index) const { return (usize)index.y * size.x + index.x; }
+
+    TileType getType(sf::Vector2i index) const { return static_cast<TileType>(types[offset(index)]); }
+    void setType(sf::Vector2i index, TileType type) { types[offset(index)] = type; }
+
+    sf::Color getTint(sf::Vector2i index) const {
+        if (tints.empty())
+            return sf::Color::White;
+        auto it = tints.find(offset(index));
+        return it == tints.end() ? sf::Color::White : it->second;
+    }
+    void setTint(sf::Vector2i index, sf::Color tint) {
+        if (tint == sf::Color::White)
+            tints.erase(offset(index));
+        else
+            tints[offset(index)] = tint;
+    }
+
+    u8 getFlags(sf::Vector2i index) const {
+        if (flags.empty())
+            return TILE_NONE;
+        auto it = flags.find(offset(index));
+        return it == flags.end() ? (u8)TILE_NONE : it->second;
+    }
+    void setFlags(sf::Vector2i index, u8 value) {
+        if (value == TILE_NONE)
+            flags.erase(offset(index));
+        else
+            flags[offset(index)] = value;
+    }
+
+    usize memoryUsage() const {
+        // Hash nodes carry a next pointer and the cached key on top of the entry.
+        usize node = 2 * sizeof(void*);
+        return types.capacity() * sizeof(u8)
+            + flags.size() * (sizeof(std::pair<const u32, u8>) + node) + flags.bucket_count() * sizeof(void*)
+            + tints.size() * (sizeof(std::pair<const u32, sf::Color>) + node) + tints.bucket_count() * sizeof(void*);
+    }
 };
 
-struct Room
+// Range of map cells whose sprites touch a screen rect, in isometric (x - y, x + y) space.
+struct MapBounds
 {
-    std::vector<Tile> tiles;
+    i32 minDiff, maxDiff;
+    i32 minSum, maxSum;
 
-    Room(const std::vector<sf::IntRect>& rects, sf::Texture &tileset) {
-        std::unordered_set<sf::Vector2i, VectorHash> points;
-        for (const auto& rect: rects)
-            for (i32 y = 0; y < rect.size.y; y++)
-                for (i32 x = 0; x < rect.size.x; x++)
-                    points.emplace(rect.position.x + x, rect.position.y + y);
-
-        std::vector<sf::Vector2i> straightWalls;
-        for (auto& point: points) {
-            TileType type = determineTileType(points, point);
-            tiles.emplace_back(tileset, point, type);
-
-            if (type == WALL_LEFT || type == WALL_RIGHT || type == WALL_UP || type == WALL_DOWN)
-                straightWalls.push_back(point);
-        }
-
-        sf::Vector2i entrancePoint = straightWalls[rand() % straightWalls.size()];
-        Tile* entrance = nullptr;
-        for (u32 i = 0; entrance == nullptr && i < tiles.size(); i++)
-            if (tiles[i].point == entrancePoint)
-                entrance = &tiles[i];
-
-        switch (entrance->type) {
-            case WALL_LEFT:     entrance->type = ENTRANCE_LEFT;     break;
-            case WALL_RIGHT:    entrance->type = ENTRANCE_RIGHT;    break;
-            case WALL_UP:       entrance->type = ENTRANCE_UP;       break;
-            case WALL_DOWN:     entrance->type = ENTRANCE_DOWN;     break;
-            default:                                                break;
-        }
+    bool contains(sf::Vector2i index) const {
+        i32 diff = index.x - index.y;
+        i32 sum = index.x + index.y;
+        return diff >= minDiff && diff <= maxDiff && sum >= minSum && sum <= maxSum;
     }
 
-    TileType determineTileType(std::unordered_set<sf::Vector2i, VectorHash>& points, const sf::Vector2i& point) {
-        sf::Vector2i neighbors[8] = {
-            { point.x + 1, point.y },     // Right
-            { point.x - 1, point.y },     // Left
-            { point.x,     point.y + 1 }, // Down
-            { point.x,     point.y - 1 }, // Up
-            { point.x + 1, point.y + 1 }, // Down-Right
-            { point.x - 1, point.y + 1 }, // Down-Left
-            { point.x + 1, point.y - 1 }, // Up-Right
-            { point.x - 1, point.y - 1 }  // Up-Left
-        };
-
-        int mask = 0;
-        if (points.find(neighbors[0]) == points.end()) mask |= 1;
-        if (points.find(neighbors[1]) == points.end()) mask |= 2;
-        if (points.find(neighbors[2]) == points.end()) mask |= 4;
-        if (points.find(neighbors[3]) == points.end()) mask |= 8;
-
-        switch (mask) {
-            case 5:     return WALL_CORNER_DOWN_RIGHT;  // 0101
-            case 6:     return WALL_CORNER_DOWN_LEFT;   // 0110
-            case 9:     return WALL_CORNER_UP_RIGHT;    // 1001
-            case 10:    return WALL_CORNER_UP_LEFT;     // 1010
-            case 1:     return WALL_RIGHT;
-            case 2:     return WALL_LEFT;
-            case 4:     return WALL_DOWN;
-            case 8:     return WALL_UP;
-            case 0:
-                if (points.find(neighbors[4]) == points.end()) return WALL_JUNCTION_DOWN_RIGHT;
-                if (points.find(neighbors[5]) == points.end()) return WALL_JUNCTION_DOWN_LEFT;
-                if (points.find(neighbors[6]) == points.end()) return WALL_JUNCTION_UP_RIGHT;
-                if (points.find(neighbors[7]) == points.end()) return WALL_JUNCTION_UP_LEFT;
-                break;
-        }
-
-        return ROOM;
+    bool intersects(sf::IntRect rect) const {
+        sf::Vector2i end = rect.position + rect.size - sf::Vector2i(1, 1);
+        return rect.position.x - end.y <= maxDiff && end.x - rect.position.y >= minDiff
+            && rect.position.x + rect.position.y <= maxSum && end.x + end.y >= minSum;
     }
+
+    // Columns visible somewhere within rows [top, bottom], as an inclusive range.
+    sf::Vector2i columns(i32 top, i32 bottom) const {
+        return { std::max(minDiff + top, minSum - bottom), std::min(maxDiff + bottom, maxSum - top) };
+    }
+
+    sf::Vector2i rows() const {
+        return { (i32)std::floor((minSum - maxDiff) / 2.f), (i32)std::ceil((maxSum - minDiff) / 2.f) };
+    }
+
+    // Indices of the blockSize x blockSize cell blocks of a map that these bounds touch.
+    std::vector<sf::Vector2i> blocks(sf::Vector2i mapSize, i32 blockSize) const;
 };
 
-struct Layer
+// What viewers have seen, for drawing fog of war: unexplored cells are left out
+// and explored ones out of sight are dimmed.
+struct Fog
 {
-    std::vector<std::vector<Tile>> tiles;
-
-    Layer(sf::Vector2i mapSize, sf::Texture &tileset) {
-        tiles.resize(mapSize.y);
-        for (i32 y = 0; y < mapSize.y; y++) {
-            tiles[y].reserve(mapSize.x);
-            for (i32 x = 0; x < mapSize.x; x++)
-                tiles[y].emplace_back(tileset);
-        }
+    const Bitmap& explored;
+    const Bitmap& visible;
+};
+
+// A cell of one layer whose type, tint or flags changed.
+struct TileChange
+{
+    sf::Vector2i cell;
+    u32 layer;
+};
+
+// Buffers generate() reuses from one level to the next, so regenerating a level of
+// the same size allocates nothing once they have grown to fit. They are not level
+// state: a copied level starts with empty scratch.
+struct GenerationScratch
+{
+    Bitmap occupied;
+    RoomScratch room;
+    // Tiles of every placed room back to back; room i ends at roomEnds[i].
+    std::vector<Tile> tiles;
+    std::vector<u32> roomEnds;
+    std::vector<RoomInfo> rooms;
+
+    GenerationScratch(): occupied(sf::IntRect()) {}
+    GenerationScratch(const GenerationScratch&): GenerationScratch() {}
+    GenerationScratch(GenerationScratch&&) = default;
+    GenerationScratch& operator=(const GenerationScratch&) { return *this; }
+    GenerationScratch& operator=(GenerationScratch&&) = default;
+
+    usize memoryUsage() const {
+        return occupied.bits.capacity() * sizeof(u64) + room.points.bits.capacity() * sizeof(u64)
+            + room.straightWalls.capacity() * sizeof(u32) + room.rowTypes.capacity() * sizeof(TileType)
+            + tiles.capacity() * sizeof(Tile) + roomEnds.capacity() * sizeof(u32)
+            + rooms.capacity() * sizeof(RoomInfo);
     }
 };
 
-struct Level : public sf::Drawable
+// Smallest map side generate() handles: the largest room shape plus its margins.
+constexpr i32 minMapSize = 16;
+
+// Receives generation progress in [0, 1]; may be called from a worker thread.
+using GenerateProgress = std::function<void(f32)>;
+
+struct Level
 {
     std::vector<Layer> layers;
+    std::vector<RoomInfo> rooms;
     sf::Vector2i mapSize;
     sf::Vector2f tileSize;
     sf::Vector2f tilesetSize;
     sf::IntRect center;
+    u32 maxRooms;
+    u32 maxAttempts;
+    u64 seed;
+    // Tileset rect of every tile type, built once for this tileset's sprite size.
+    std::array<sf::FloatRect, TILE_TYPE_COUNT> textureRects;
+    // Cells changed by the setTile* calls since the consumer last cleared this;
+    // renderers patch just these instead of rebuilding the map.
+    std::vector<TileChange> dirtyCells;
+    GenerationScratch scratch;
 
     Level() = delete;
     Level(sf::Vector2i _mapSize, sf::Vector2f tileSize, sf::Vector2f tilesetSize);
 
-    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+    void generate(u64 seed, const GenerateProgress& progress = nullptr);
+    void buildTextureRects();
+    const sf::FloatRect& textureRect(TileType type) const {
+        return textureRects[type < TILE_TYPE_COUNT ? type : EMPTY];
+    }
+    void appendQuads(const Layer& layer, sf::IntRect area, std::vector<sf::Vertex>& vertices,
+                     std::vector<u32>* depthStarts = nullptr, const Fog* fog = nullptr);
+    // The quads of one isometric row (x + y == depth) of `area`, as appendQuads emits them.
+    void appendRow(const Layer& layer, sf::IntRect area, i32 depth, std::vector<sf::Vertex>& vertices,
+                   const Fog* fog = nullptr);
+    // Places rooms into scratch.rooms and scratch.tiles without touching the layers.
+    void placeRooms(Rng& rng, const GenerateProgress& progress = nullptr);
+    std::vector<Room> generateRooms(Rng& rng, const GenerateProgress& progress = nullptr);
+    RoomRects createRoomShape(const sf::Vector2i& pos, RoomShape shape, Rng& rng);
+    bool roomCanBePlaced(const RoomRects& rects, const Bitmap& occupied);
 
-    void generate(sf::Texture& tileset);
-    sf::IntRect determineTextureRect(TileType type);
-    std::vector<Room> generateRooms(sf::Texture &tileset);
-    std::vector<sf::IntRect> createRoomShape(const sf::Vector2i& pos, RoomShape shape);
-    bool roomCanBePlaced(std::vector<sf::IntRect>& rects, std::vector<sf::IntRect>& others);
+    // Runtime edits, recorded in dirtyCells when they change anything. Layers above
+    // the ground are autotiled: with `retileNeighbors`, a cell becoming occupied or empty
+    // re-classifies the occupied cells around it, itself included. Entrances are kept.
+    void setTileType(u32 layer, sf::Vector2i index, TileType type, bool retileNeighbors = true);
+    void setTileTint(u32 layer, sf::Vector2i index, sf::Color tint);
+    void setTileFlags(u32 layer, sf::Vector2i index, u8 flags);
+    void retile(u32 layer, sf::Vector2i index);
 
-    sf::Sprite* getSprite(sf::Vector2i index);
+    // Topmost layer with a tile at `index`, or -1.
+    i32 topLayer(sf::Vector2i index) const;
+    u64 hash() const;
+    usize memoryUsage() const;
 
     bool outOfBounds(sf::Vector2i index);
+    bool contains(sf::Vector2i index) const {
+        return index.x >= 0 && index.y >= 0 && index.x < mapSize.x && index.y < mapSize.y;
+    }
     bool outOfBounds(sf::IntRect rect);
+    static sf::IntRect withMargin(sf::IntRect rect);
     sf::Vector2f mapToScreen(sf::Vector2i index);
     sf::Vector2i screenToMap(sf::Vector2f point);
+    MapBounds visibleBounds(sf::FloatRect screen);
 };
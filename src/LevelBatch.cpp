@@ -0,0 +1,27 @@
+#include "LevelBatch.hpp"
+#include <atomic>
+#include <thread>
+
+std::vector<Level> generateBatch(const Level& prototype, const std::vector<u64>& seeds, u32 threads) {
+    std::vector<Level> levels(seeds.size(), prototype);
+    std::atomic<usize> next(0);
+
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::min<usize>(threads, std::max<usize>(seeds.size(), 1));
+
+    auto worker = [&]() {
+        for (usize i = next++; i < seeds.size(); i = next++)
+            levels[i].generate(seeds[i]);
+    };
+
+    std::vector<std::thread> workers;
+    for (u32 i = 1; i < threads; i++)
+        workers.emplace_back(worker);
+
+    worker();
+    for (auto& thread: workers)
+        thread.join();
+
+    return levels;
+}
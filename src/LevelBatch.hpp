@@ -0,0 +1,9 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+
+// Generates one level per seed, copying map size and room budgets from `prototype`.
+// Work is spread over `threads` workers (0 = all cores); since a level only depends
+// on its seed, the output is identical for any thread count.
+std::vector<Level> generateBatch(const Level& prototype, const std::vector<u64>& seeds, u32 threads = 0);
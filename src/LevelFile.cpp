@@ -0,0 +1,128 @@
+#include "LevelFile.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    munmap(address, length);
+}
+
+bool saveLevel(const Level& level, const std::string& path) {
+    LevelFileHeader header = {};
+    header.fileMagic = LevelFileHeader::magic;
+    header.version = LevelFileHeader::currentVersion;
+    header.mapWidth = level.mapSize.x;
+    header.mapHeight = level.mapSize.y;
+    header.tileWidth = level.tileSize.x;
+    header.tileHeight = level.tileSize.y;
+    header.tilesetWidth = level.tilesetSize.x;
+    header.tilesetHeight = level.tilesetSize.y;
+    header.seed = level.seed;
+    header.center[0] = level.center.position.x;
+    header.center[1] = level.center.position.y;
+    header.center[2] = level.center.size.x;
+    header.center[3] = level.center.size.y;
+    header.maxRooms = level.maxRooms;
+    header.maxAttempts = level.maxAttempts;
+    header.layerCount = level.layers.size();
+    header.roomCount = level.rooms.size();
+    header.layerOffset = sizeof(LevelFileHeader) + level.rooms.size() * sizeof(RoomInfo);
+
+    std::string temporary = path + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "wb");
+    if (!file) {
+        printf("Could not open %s for writing\n", temporary.c_str());
+        return false;
+    }
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    if (ok && !level.rooms.empty())
+        ok = std::fwrite(level.rooms.data(), sizeof(RoomInfo), level.rooms.size(), file) == level.rooms.size();
+    for (const auto& layer: level.layers)
+        if (ok)
+            ok = std::fwrite(layer.types.data(), 1, layer.types.size(), file) == layer.types.size();
+
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        printf("Could not write %s\n", path.c_str());
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// Whether `rect` lies entirely within a map of `mapSize`, without overflowing on hostile values.
+static bool insideMap(sf::IntRect rect, sf::Vector2i mapSize) {
+    return rect.position.x >= 0 && rect.position.y >= 0 && rect.size.x >= 0 && rect.size.y >= 0
+        && (i64)rect.position.x + rect.size.x <= mapSize.x && (i64)rect.position.y + rect.size.y <= mapSize.y;
+}
+
+std::optional<Level> loadLevel(const std::string& path) {
+    i32 fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("Could not open %s\n", path.c_str());
+        return std::nullopt;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (usize)info.st_size < sizeof(LevelFileHeader)) {
+        printf("%s is not a level file\n", path.c_str());
+        close(fd);
+        return std::nullopt;
+    }
+
+    usize length = info.st_size;
+    void* address = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED) {
+        printf("Could not map %s\n", path.c_str());
+        return std::nullopt;
+    }
+
+    auto mapping = std::make_shared<MappedFile>(address, length);
+    u8* bytes = static_cast<u8*>(address);
+    LevelFileHeader header;
+    std::memcpy(&header, bytes, sizeof(header));
+
+    usize layerSize = (usize)header.mapWidth * header.mapHeight;
+    if (header.fileMagic != LevelFileHeader::magic || header.version != LevelFileHeader::currentVersion
+        || header.mapWidth <= 0 || header.mapHeight <= 0
+        || header.roomCount > (length - sizeof(LevelFileHeader)) / sizeof(RoomInfo)
+        || header.layerOffset != sizeof(LevelFileHeader) + (usize)header.roomCount * sizeof(RoomInfo)
+        || header.layerOffset > length || header.layerCount < 1
+        || header.layerCount > (length - header.layerOffset) / layerSize) {
+        printf("%s is not a compatible level file\n", path.c_str());
+        return std::nullopt;
+    }
+
+    Level level({ header.mapWidth, header.mapHeight },
+                { header.tileWidth, header.tileHeight },
+                { header.tilesetWidth, header.tilesetHeight });
+    level.seed = header.seed;
+    level.center = sf::IntRect({ header.center[0], header.center[1] }, { header.center[2], header.center[3] });
+    level.maxRooms = header.maxRooms;
+    level.maxAttempts = header.maxAttempts;
+
+    level.rooms.resize(header.roomCount);
+    if (header.roomCount)
+        std::memcpy(level.rooms.data(), bytes + sizeof(LevelFileHeader), header.roomCount * sizeof(RoomInfo));
+
+    // Spawning and room lookups index tiles by these, so they have to be on the map.
+    bool inside = insideMap(level.center, level.mapSize);
+    for (const auto& room: level.rooms)
+        inside = inside && insideMap(room.bounds, level.mapSize) && level.contains(room.entrance);
+    if (!inside) {
+        printf("%s has rooms outside its map\n", path.c_str());
+        return std::nullopt;
+    }
+
+    for (u32 i = 0; i < header.layerCount; i++) {
+        TileBuffer types(mapping, bytes + header.layerOffset + i * layerSize, layerSize);
+        level.layers.emplace_back(level.mapSize, std::move(types));
+    }
+
+    return level;
+}
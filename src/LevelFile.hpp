@@ -0,0 +1,36 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+#include <optional>
+#include <string>
+
+// Binary level snapshot, little-endian:
+//   LevelFileHeader
+//   RoomInfo[roomCount]
+//   u8[mapSize.x * mapSize.y] per layer, starting at layerOffset
+// Layers hold only tile types; tints and flags are runtime state and are not saved.
+struct LevelFileHeader
+{
+    static constexpr u32 magic = 0x4C4B5247; // "GRKL"
+    static constexpr u32 currentVersion = 1;
+
+    u32 fileMagic;
+    u32 version;
+    i32 mapWidth, mapHeight;
+    f32 tileWidth, tileHeight;
+    f32 tilesetWidth, tilesetHeight;
+    u64 seed;
+    i32 center[4];
+    u32 maxRooms;
+    u32 maxAttempts;
+    u32 layerCount;
+    u32 roomCount;
+    u64 layerOffset;
+};
+
+bool saveLevel(const Level& level, const std::string& path);
+
+// Maps the file and points the level's layers directly at it; tiles are only
+// read from disk as their pages are touched.
+std::optional<Level> loadLevel(const std::string& path);
@@ -0,0 +1,89 @@
+#include "LevelGenerator.hpp"
+
+LevelGenerator::LevelGenerator():
+    level({ 0, 0 }, { 0.f, 0.f }, { 0.f, 0.f }),
+    ready(false),
+    generation(0),
+    quit(false),
+    busy(false),
+    progress(0.f)
+{
+    worker = std::thread(&LevelGenerator::run, this);
+}
+
+LevelGenerator::~LevelGenerator() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void LevelGenerator::request(const Level& settings, u64 seed) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = LevelRequest { settings.mapSize, settings.tileSize, settings.tilesetSize,
+                                 settings.maxRooms, settings.maxAttempts, seed };
+        ready = false;
+        generation++;
+        requested.restart();
+        busy = true;
+        progress = 0.f;
+    }
+    wake.notify_one();
+}
+
+void LevelGenerator::cancel() {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.reset();
+    ready = false;
+    generation++;
+    busy = false;
+}
+
+bool LevelGenerator::poll(Level& live) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!ready)
+        return false;
+
+    // The worker is idle until the next request, so it can take the old level's
+    // buffers to generate into.
+    std::swap(live, level);
+    ready = false;
+    return true;
+}
+
+void LevelGenerator::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wake.wait(lock, [this]() { return quit || pending; });
+        if (quit)
+            return;
+
+        LevelRequest next = *pending;
+        pending.reset();
+        u64 started = generation;
+        lock.unlock();
+
+        level.mapSize = next.mapSize;
+        level.maxRooms = next.maxRooms;
+        level.maxAttempts = next.maxAttempts;
+        if (level.tileSize != next.tileSize || level.tilesetSize != next.tilesetSize) {
+            level.tileSize = next.tileSize;
+            level.tilesetSize = next.tilesetSize;
+            level.buildTextureRects();
+        }
+        level.dirtyCells.clear();
+        level.generate(next.seed, [this](f32 value) { progress = value; });
+
+        lock.lock();
+        if (generation != started)
+            continue;
+
+        ready = true;
+        latency = requested.getElapsedTime();
+        busy = false;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+// Size, budgets and seed of a level to generate.
+struct LevelRequest
+{
+    sf::Vector2i mapSize;
+    sf::Vector2f tileSize;
+    sf::Vector2f tilesetSize;
+    u32 maxRooms;
+    u32 maxAttempts;
+    u64 seed;
+};
+
+// Generates levels on a background thread. The finished level waits in its own
+// buffer until poll() swaps it into the live one, so callers decide at which
+// frame boundary the switch happens.
+struct LevelGenerator
+{
+    std::optional<LevelRequest> pending;
+    // The worker's level. poll() swaps it with the live one, so the two trade
+    // layers and scratch back and forth and generating reuses their buffers.
+    Level level;
+    // `level` holds a finished level that poll() has not taken yet.
+    bool ready;
+    // Bumped by every request and cancel, so a level that finishes after either is dropped.
+    u64 generation;
+    bool quit;
+
+    std::atomic<bool> busy;
+    std::atomic<f32> progress;
+    sf::Clock requested;
+    sf::Time latency;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+
+    LevelGenerator();
+    ~LevelGenerator();
+
+    // Starts generating `seed` with the size and room budgets of `settings`.
+    // A newer request replaces one that has not finished yet.
+    void request(const Level& settings, u64 seed);
+
+    // Drops pending and finished work, e.g. because the live level was replaced another way.
+    void cancel();
+
+    // Swaps a finished level into `level`. Returns false if none is ready.
+    bool poll(Level& level);
+
+    void run();
+};
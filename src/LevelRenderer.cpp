@@ -0,0 +1,298 @@
+#include "LevelRenderer.hpp"
+#include "Profiler.hpp"
+
+LevelRenderer::LevelRenderer(Level& _level, const sf::Texture& _tileset):
+    level(&_level),
+    tileset(&_tileset),
+    players(nullptr),
+    playerTexture(nullptr),
+    frame(0),
+    impostors(_level, _tileset, chunkSize, impostorBudget)
+{}
+
+void LevelRenderer::attachPlayers(const PlayerManager& _players, const sf::Texture& texture) {
+    players = &_players;
+    playerTexture = &texture;
+}
+
+void LevelRenderer::attachVisibility(const Visibility* visibility) {
+    fog.reset();
+    if (visibility)
+        fog.emplace(visibility->fog());
+    rebuild();
+}
+
+void LevelRenderer::draw(sf::RenderTarget& target, sf::RenderStates states) const {
+    PROFILE_SCOPE("Level::draw");
+    states.texture = tileset;
+
+    const sf::View& view = target.getView();
+    sf::FloatRect screen(view.getCenter() - view.getSize() / 2.f, view.getSize());
+    MapBounds bounds = level->visibleBounds(screen);
+
+    frame++;
+    patchDirty();
+
+    f32 scale = target.getSize().x / view.getSize().x;
+    if (scale < ImpostorCache::threshold) {
+        drawImpostors(target, states, bounds, screen, scale);
+        evict();
+        return;
+    }
+
+    std::vector<sf::Vector2i> visible = visibleChunks(bounds);
+    for (const auto& chunkIndex: visible) {
+        Chunk& chunk = getChunk(chunkIndex);
+        if (!chunk.built)
+            buildChunk(chunkIndex);
+        chunk.lastDrawn = frame;
+    }
+
+    // The ground layer is flat, so nothing can stand behind it; draw it chunk by chunk.
+    for (const auto& chunkIndex: visible) {
+        const Chunk& chunk = getChunk(chunkIndex);
+        if (chunk.layers.empty() || chunk.layers[0].empty())
+            continue;
+
+        const std::vector<sf::Vertex>& vertices = chunk.layers[0];
+        target.draw(vertices.data(), vertices.size(), sf::PrimitiveType::Triangles, states);
+        stats.drawCalls++;
+        stats.quads += vertices.size() / 6;
+    }
+
+    drawDepthSorted(target, states, visible, bounds, screen);
+    stats.chunksDrawn += visible.size();
+    evict();
+}
+
+void LevelRenderer::drawDepthSorted(sf::RenderTarget& target, sf::RenderStates states, const std::vector<sf::Vector2i>& visible,
+                                    const MapBounds& bounds, sf::FloatRect screen) const {
+    // Only rows inside the map can hold walls, so the walk is bounded by the map
+    // however far the view is zoomed out.
+    i32 minDepth = std::max(bounds.minSum, 0);
+    i32 maxDepth = std::min(bounds.maxSum, level->mapSize.x + level->mapSize.y - 2);
+
+    // Bucket the upper layers' vertex ranges by isometric row. Chunks already store
+    // their quads row by row, so this only records pointers into them.
+    usize rowCount = std::max(maxDepth - minDepth + 1, 0);
+    if (depthRows.size() < rowCount)
+        depthRows.resize(rowCount);
+    for (usize i = 0; i < rowCount; i++)
+        depthRows[i].clear();
+
+    for (u32 layer = 1; layer < level->layers.size(); layer++) {
+        for (const auto& chunkIndex: visible) {
+            const Chunk& chunk = getChunk(chunkIndex);
+            const std::vector<u32>& starts = chunk.depthStarts[layer];
+            i32 firstDepth = (chunkIndex.x + chunkIndex.y) * chunkSize;
+
+            for (u32 i = 0; i + 1 < starts.size(); i++) {
+                i32 depth = firstDepth + i;
+                if (depth < minDepth || depth > maxDepth || starts[i] == starts[i + 1])
+                    continue;
+
+                depthRows[depth - minDepth].push_back({ &chunk.layers[layer][starts[i]], starts[i + 1] - starts[i] });
+            }
+        }
+    }
+
+    // Players off the map's rows have no walls to sort against; draw them before
+    // or after the map in their own depth order.
+    offMapDepths.clear();
+    if (players) {
+        for (const auto& [depth, bucket]: players->buckets)
+            if (!bucket.empty() && (depth < minDepth || depth > maxDepth) && depth >= bounds.minSum && depth <= bounds.maxSum)
+                offMapDepths.push_back(depth);
+        std::sort(offMapDepths.begin(), offMapDepths.end());
+    }
+
+    auto behind = std::partition_point(offMapDepths.begin(), offMapDepths.end(), [&](i32 depth) { return depth < minDepth; });
+    for (auto it = offMapDepths.begin(); it != behind; it++)
+        drawPlayers(target, states, *it, screen);
+
+    // Walk rows back to front; a row's walls are drawn before the players standing
+    // in it, so a draw call is only needed where players break up the tile batch.
+    batch.clear();
+    for (i32 depth = minDepth; depth <= maxDepth; depth++) {
+        for (const auto& range: depthRows[depth - minDepth])
+            batch.insert(batch.end(), range.vertices, range.vertices + range.count);
+
+        if (players && players->playersAtDepth(depth))
+            drawPlayers(target, states, depth, screen);
+    }
+
+    flush(target, states);
+    for (auto it = behind; it != offMapDepths.end(); it++)
+        drawPlayers(target, states, *it, screen);
+}
+
+void LevelRenderer::drawImpostors(sf::RenderTarget& target, sf::RenderStates states, const MapBounds& bounds,
+                                  sf::FloatRect screen, f32 scale) const {
+    impostors.draw(target, states, bounds, scale, fogOfWar(), stats);
+    if (!players)
+        return;
+
+    playerVertices.clear();
+    players->appendQuads(screen, playerVertices);
+    if (playerVertices.empty())
+        return;
+
+    states.texture = playerTexture;
+    target.draw(playerVertices.data(), playerVertices.size(), sf::PrimitiveType::Triangles, states);
+    stats.drawCalls++;
+    stats.quads += playerVertices.size() / 6;
+}
+
+void LevelRenderer::drawPlayers(sf::RenderTarget& target, sf::RenderStates states, i32 depth, sf::FloatRect screen) const {
+    playerVertices.clear();
+    players->appendQuads(depth, screen, playerVertices);
+    if (playerVertices.empty())
+        return;
+
+    flush(target, states);
+    states.texture = playerTexture;
+    target.draw(playerVertices.data(), playerVertices.size(), sf::PrimitiveType::Triangles, states);
+    stats.drawCalls++;
+    stats.quads += playerVertices.size() / 6;
+}
+
+void LevelRenderer::flush(sf::RenderTarget& target, sf::RenderStates states) const {
+    if (batch.empty())
+        return;
+
+    target.draw(batch.data(), batch.size(), sf::PrimitiveType::Triangles, states);
+    stats.drawCalls++;
+    stats.quads += batch.size() / 6;
+    batch.clear();
+}
+
+std::vector<sf::Vector2i> LevelRenderer::visibleChunks(const MapBounds& bounds) const {
+    return bounds.blocks(level->mapSize, chunkSize);
+}
+
+void LevelRenderer::setLevel(Level& _level) {
+    level = &_level;
+    rebuild();
+}
+
+void LevelRenderer::rebuild() {
+    chunkCount = {
+        (level->mapSize.x + chunkSize - 1) / chunkSize,
+        (level->mapSize.y + chunkSize - 1) / chunkSize
+    };
+
+    chunks.clear();
+    chunks.resize(chunkCount.x * chunkCount.y);
+    impostors.reset(*level);
+    residentChunks.clear();
+    dirtyChunks.clear();
+}
+
+void LevelRenderer::invalidate(sf::Vector2i index) {
+    if (index.x < 0 || index.x >= level->mapSize.x || index.y < 0 || index.y >= level->mapSize.y)
+        return;
+
+    sf::Vector2i chunkIndex(index.x / chunkSize, index.y / chunkSize);
+    getChunk(chunkIndex).built = false;
+    impostors.invalidate(chunkIndex);
+}
+
+void LevelRenderer::markDirty(const TileChange& change) {
+    if (!level->contains(change.cell) || change.layer >= level->layers.size())
+        return;
+
+    sf::Vector2i chunkIndex(change.cell.x / chunkSize, change.cell.y / chunkSize);
+    impostors.invalidate(chunkIndex);
+    Chunk& chunk = getChunk(chunkIndex);
+    if (!chunk.built)
+        return;
+
+    chunk.dirtyRows[change.layer] |= 1u << (change.cell.x % chunkSize + change.cell.y % chunkSize);
+    if (!chunk.dirty) {
+        chunk.dirty = true;
+        dirtyChunks.push_back(chunkIndex.y * chunkCount.x + chunkIndex.x);
+    }
+}
+
+void LevelRenderer::buildChunk(sf::Vector2i chunkIndex) const {
+    Chunk& chunk = getChunk(chunkIndex);
+    chunk.built = true;
+    stats.chunksBuilt++;
+    if (!chunk.resident) {
+        chunk.resident = true;
+        residentChunks.push_back(chunkIndex.y * chunkCount.x + chunkIndex.x);
+    }
+
+    chunk.dirty = false;
+    chunk.dirtyRows.assign(level->layers.size(), 0);
+    chunk.layers.clear();
+    chunk.layers.resize(level->layers.size());
+    chunk.depthStarts.clear();
+    chunk.depthStarts.resize(level->layers.size());
+
+    sf::Vector2i start = chunkIndex * chunkSize;
+    sf::Vector2i end = {
+        std::min(start.x + chunkSize, level->mapSize.x),
+        std::min(start.y + chunkSize, level->mapSize.y)
+    };
+    for (u32 i = 0; i < level->layers.size(); i++)
+        level->appendQuads(level->layers[i], sf::IntRect(start, end - start), chunk.layers[i], &chunk.depthStarts[i],
+                           fogOfWar());
+}
+
+void LevelRenderer::patchDirty() const {
+    for (u32 chunkOffset: dirtyChunks) {
+        // Chunks invalidated since are rebuilt whole anyway.
+        Chunk& chunk = chunks[chunkOffset];
+        if (!chunk.dirty || !chunk.built)
+            continue;
+
+        sf::Vector2i start(chunkOffset % chunkCount.x * chunkSize, chunkOffset / chunkCount.x * chunkSize);
+        sf::IntRect area(start, {
+            std::min(chunkSize, level->mapSize.x - start.x),
+            std::min(chunkSize, level->mapSize.y - start.y)
+        });
+
+        for (u32 layer = 0; layer < chunk.layers.size(); layer++) {
+            std::vector<sf::Vertex>& vertices = chunk.layers[layer];
+            std::vector<u32>& starts = chunk.depthStarts[layer];
+
+            // Swap each dirty row's vertex range for freshly generated quads and
+            // shift the rows after it; the rest of the chunk is left alone.
+            for (u32 rows = chunk.dirtyRows[layer]; rows; rows &= rows - 1) {
+                u32 row = __builtin_ctz(rows);
+                rowVertices.clear();
+                level->appendRow(level->layers[layer], area, start.x + start.y + row, rowVertices, fogOfWar());
+
+                u32 begin = starts[row];
+                u32 end = starts[row + 1];
+                vertices.erase(vertices.begin() + begin, vertices.begin() + end);
+                vertices.insert(vertices.begin() + begin, rowVertices.begin(), rowVertices.end());
+
+                i32 delta = (i32)rowVertices.size() - (i32)(end - begin);
+                for (u32 i = row + 1; i < starts.size(); i++)
+                    starts[i] += delta;
+                stats.rowsPatched++;
+            }
+            chunk.dirtyRows[layer] = 0;
+        }
+        chunk.dirty = false;
+    }
+    dirtyChunks.clear();
+}
+
+void LevelRenderer::evict() const {
+    // Only chunks that were built are resident, so this scales with the cache, not the map.
+    for (usize i = 0; i < residentChunks.size();) {
+        Chunk& chunk = chunks[residentChunks[i]];
+        if (frame - chunk.lastDrawn <= evictAfter) {
+            i++;
+            continue;
+        }
+
+        chunk = Chunk();
+        stats.chunksEvicted++;
+        residentChunks[i] = residentChunks.back();
+        residentChunks.pop_back();
+    }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+#include "PlayerManager.hpp"
+#include "ImpostorCache.hpp"
+#include "Visibility.hpp"
+#include <optional>
+
+struct RenderStats
+{
+    u32 drawCalls = 0;
+    u32 chunksDrawn = 0;
+    u32 chunksBuilt = 0;
+    u32 quads = 0;
+    u32 chunksEvicted = 0;
+    u32 rowsPatched = 0;
+    u32 impostorsBaked = 0;
+
+    void reset() { *this = RenderStats(); }
+};
+
+struct Chunk
+{
+    std::vector<std::vector<sf::Vertex>> layers;
+    // Per layer, the first vertex of each isometric row in the chunk, plus an end marker.
+    std::vector<std::vector<u32>> depthStarts;
+    // Per layer, a bit for each isometric row whose tiles changed since it was built.
+    std::vector<u32> dirtyRows;
+    bool built = false;
+    bool dirty = false;
+    bool resident = false;
+    u64 lastDrawn = 0;
+};
+
+struct VertexRange
+{
+    const sf::Vertex* vertices;
+    u32 count;
+};
+
+struct LevelRenderer : public sf::Drawable
+{
+    static constexpr i32 chunkSize = 16;
+    // Frames a chunk may stay off screen before its geometry is freed.
+    static constexpr u64 evictAfter = 120;
+    static_assert(2 * chunkSize - 1 <= 32, "a chunk's rows must fit the dirty row mask");
+    static constexpr usize impostorBudget = 64u << 20;
+
+    Level* level;
+    const sf::Texture* tileset;
+    const PlayerManager* players;
+    const sf::Texture* playerTexture;
+    // Set while fog of war is drawn from a Visibility's layers.
+    std::optional<Fog> fog;
+    sf::Vector2i chunkCount;
+    mutable std::vector<Chunk> chunks;
+    mutable std::vector<u32> residentChunks;
+    mutable std::vector<u32> dirtyChunks;
+    mutable u64 frame;
+    mutable RenderStats stats;
+    mutable std::vector<std::vector<VertexRange>> depthRows;
+    mutable std::vector<sf::Vertex> batch;
+    mutable std::vector<sf::Vertex> playerVertices;
+    mutable std::vector<i32> offMapDepths;
+    mutable std::vector<sf::Vertex> rowVertices;
+    mutable ImpostorCache impostors;
+
+    LevelRenderer() = delete;
+    LevelRenderer(Level& level, const sf::Texture& tileset);
+
+    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+
+    void attachPlayers(const PlayerManager& players, const sf::Texture& texture);
+    // Draws fog of war from `visibility`, or none when null. Cells whose visible
+    // bit flips must be passed to markDirty for every layer.
+    void attachVisibility(const Visibility* visibility);
+    const Fog* fogOfWar() const { return fog ? &*fog : nullptr; }
+    void drawDepthSorted(sf::RenderTarget& target, sf::RenderStates states, const std::vector<sf::Vector2i>& visible,
+                         const MapBounds& bounds, sf::FloatRect screen) const;
+    void drawPlayers(sf::RenderTarget& target, sf::RenderStates states, i32 depth, sf::FloatRect screen) const;
+    // Zoomed out past the impostor threshold: baked blocks, then players on top unsorted.
+    void drawImpostors(sf::RenderTarget& target, sf::RenderStates states, const MapBounds& bounds,
+                       sf::FloatRect screen, f32 scale) const;
+    void flush(sf::RenderTarget& target, sf::RenderStates states) const;
+
+    void setLevel(Level& level);
+    void rebuild();
+    void invalidate(sf::Vector2i index);
+    // Queues the row holding a changed tile; built chunks regenerate only their
+    // dirty rows before the next draw, unbuilt ones pick the change up when built.
+    void markDirty(const TileChange& change);
+    void buildChunk(sf::Vector2i chunkIndex) const;
+    void patchDirty() const;
+    void evict() const;
+    std::vector<sf::Vector2i> visibleChunks(const MapBounds& bounds) const;
+
+    Chunk& getChunk(sf::Vector2i chunkIndex) const { return chunks[chunkIndex.y * chunkCount.x + chunkIndex.x]; }
+};
@@ -0,0 +1,332 @@
+#include "Minimap.hpp"
+#include "BitStream.hpp"
+#include "Profiler.hpp"
+#include <cstring>
+#include <thread>
+
+const u8 minimapColors[TILE_TYPE_COUNT][4] = {
+    { 0, 0, 0, 255 },           // EMPTY
+    { 24, 24, 40, 255 },        // SPACE
+    { 96, 80, 144, 255 },       // CENTER
+    { 112, 112, 112, 255 },     // ROOM
+    { 224, 224, 224, 255 },     // WALL_LEFT
+    { 224, 224, 224, 255 },     // WALL_RIGHT
+    { 224, 224, 224, 255 },     // WALL_UP
+    { 224, 224, 224, 255 },     // WALL_DOWN
+    { 224, 224, 224, 255 },     // WALL_CORNER_DOWN_LEFT
+    { 224, 224, 224, 255 },     // WALL_CORNER_DOWN_RIGHT
+    { 224, 224, 224, 255 },     // WALL_CORNER_UP_LEFT
+    { 224, 224, 224, 255 },     // WALL_CORNER_UP_RIGHT
+    { 224, 224, 224, 255 },     // WALL_JUNCTION_DOWN_RIGHT
+    { 224, 224, 224, 255 },     // WALL_JUNCTION_DOWN_LEFT
+    { 224, 224, 224, 255 },     // WALL_JUNCTION_UP_RIGHT
+    { 224, 224, 224, 255 },     // WALL_JUNCTION_UP_LEFT
+    { 232, 176, 56, 255 },      // ENTRANCE_LEFT
+    { 232, 176, 56, 255 },      // ENTRANCE_RIGHT
+    { 232, 176, 56, 255 },      // ENTRANCE_UP
+    { 232, 176, 56, 255 },      // ENTRANCE_DOWN
+};
+
+Minimap::Minimap(i32 _scale):
+    scale(std::max(_scale, 1)),
+    size(0, 0),
+    dirtyTop(0),
+    dirtyBottom(0)
+{}
+
+void Minimap::setPixel(usize index, u8 type) {
+    types[index] = type;
+    std::memcpy(&pixels[index * 4], minimapColors[type], 4);
+}
+
+// Topmost tile of every cell in map row `y`. Layers are merged eight cells at a
+// time: EMPTY is zero, so a byte with any bit set has a tile that covers the one below.
+static void topTypes(const Level& level, i32 y, u8* cells) {
+    const u64 high = 0x8080808080808080ull;
+    i32 width = level.mapSize.x;
+    usize base = (usize)y * width;
+
+    if (level.layers.empty()) {
+        std::fill(cells, cells + width, EMPTY);
+        return;
+    }
+
+    std::memcpy(cells, level.layers[0].types.data() + base, width);
+    for (usize i = 1; i < level.layers.size(); i++) {
+        const u8* types = level.layers[i].types.data() + base;
+        i32 x = 0;
+        for (; x + 8 <= width; x += 8) {
+            u64 upper, lower;
+            std::memcpy(&upper, types + x, 8);
+            std::memcpy(&lower, cells + x, 8);
+            u64 occupied = (((upper & ~high) + ~high) | upper) & high;
+            u64 mask = (occupied >> 7) * 0xFF;
+            lower = (upper & mask) | (lower & ~mask);
+            std::memcpy(cells + x, &lower, 8);
+        }
+        for (; x < width; x++)
+            if (types[x] != EMPTY)
+                cells[x] = types[x];
+    }
+
+    // Unknown types, which only a damaged level file holds, show as EMPTY. Adding
+    // 128 - TILE_TYPE_COUNT sets the high bit of any byte that is out of range.
+    const u64 offset = 0x0101010101010101ull * (128 - TILE_TYPE_COUNT);
+    i32 x = 0;
+    for (; x + 8 <= width; x += 8) {
+        u64 word;
+        std::memcpy(&word, cells + x, 8);
+        if (((word + offset) | word) & high) {
+            for (i32 i = x; i < x + 8; i++)
+                cells[i] = cells[i] < TILE_TYPE_COUNT ? cells[i] : (u8)EMPTY;
+        }
+    }
+    for (; x < width; x++)
+        cells[x] = cells[x] < TILE_TYPE_COUNT ? cells[x] : (u8)EMPTY;
+}
+
+// Bytewise max of two rows of tile types into `into`, eight at a time. Valid types
+// stay below 128, so a borrow out of a byte's high bit means it was the smaller.
+static void foldMax(u8* into, const u8* from, i32 width) {
+    const u64 high = 0x8080808080808080ull;
+    i32 x = 0;
+    for (; x + 8 <= width; x += 8) {
+        u64 a, b;
+        std::memcpy(&a, into + x, 8);
+        std::memcpy(&b, from + x, 8);
+        u64 mask = ((((a | high) - b) & high) >> 7) * 0xFF;
+        a = (a & mask) | (b & ~mask);
+        std::memcpy(into + x, &a, 8);
+    }
+    for (; x < width; x++)
+        into[x] = std::max(into[x], from[x]);
+}
+
+void Minimap::rasterize(const Level& level, u32 threads) {
+    PROFILE_SCOPE("Minimap::rasterize");
+    size = { (level.mapSize.x + scale - 1) / scale, (level.mapSize.y + scale - 1) / scale };
+    types.resize((usize)size.x * size.y);
+    pixels.resize(types.size() * 4);
+
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::max<u32>(std::min<i32>(threads, size.y), 1);
+
+    // Bands of whole pixel rows, so no two workers ever write the same pixel.
+    i32 band = (size.y + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (u32 t = 1; t < threads; t++)
+        workers.emplace_back([this, &level, band, t]() { rasterizeRows(level, t * band, std::min<i32>((t + 1) * band, size.y)); });
+
+    rasterizeRows(level, 0, std::min(band, size.y));
+    for (auto& worker: workers)
+        worker.join();
+
+    dirtyTop = 0;
+    dirtyBottom = size.y;
+}
+
+void Minimap::rasterizeRows(const Level& level, i32 top, i32 bottom) {
+    sf::Vector2i mapSize = level.mapSize;
+    std::vector<u8> cells(mapSize.x);
+    std::vector<u8> folded(mapSize.x);
+    std::vector<u8> row(size.x);
+
+    for (i32 py = top; py < bottom; py++) {
+        if (scale == 1) {
+            topTypes(level, py, row.data());
+        } else {
+            // The block's rows folded into one, then each run of `scale` cells into a pixel.
+            for (i32 y = py * scale; y < std::min((py + 1) * scale, mapSize.y); y++) {
+                topTypes(level, y, y == py * scale ? folded.data() : cells.data());
+                if (y != py * scale)
+                    foldMax(folded.data(), cells.data(), mapSize.x);
+            }
+            for (i32 px = 0, x = 0; px < size.x; px++) {
+                u8 best = EMPTY;
+                for (i32 end = std::min(x + scale, mapSize.x); x < end; x++)
+                    best = std::max(best, folded[x]);
+                row[px] = best;
+            }
+        }
+
+        usize start = (usize)py * size.x;
+        u8* rgba = &pixels[start * 4];
+        std::memcpy(&types[start], row.data(), size.x);
+        for (i32 px = 0; px < size.x; px++)
+            std::memcpy(rgba + px * 4, minimapColors[row[px]], 4);
+    }
+}
+
+void Minimap::update(const Level& level, sf::Vector2i cell) {
+    sf::Vector2i pixel(cell.x / scale, cell.y / scale);
+    if (!level.contains(cell) || pixel.x >= size.x || pixel.y >= size.y)
+        return;
+
+    u8 best = EMPTY;
+    for (i32 y = pixel.y * scale; y < std::min((pixel.y + 1) * scale, level.mapSize.y); y++) {
+        for (i32 x = pixel.x * scale; x < std::min((pixel.x + 1) * scale, level.mapSize.x); x++) {
+            u8 type = EMPTY;
+            for (usize layer = level.layers.size(); layer-- > 0 && type == EMPTY;)
+                type = level.layers[layer].getType({ x, y });
+            best = std::max<u8>(best, type < TILE_TYPE_COUNT ? type : (u8)EMPTY);
+        }
+    }
+
+    setPixel((usize)pixel.y * size.x + pixel.x, best);
+    dirtyTop = std::min(dirtyTop, pixel.y);
+    dirtyBottom = std::max(dirtyBottom, pixel.y + 1);
+}
+
+// PNG needs a zlib stream. The map is mostly long runs, repeated from the row
+// above, so a single fixed-Huffman deflate block with matches at distance 1 and
+// one row back compresses it well without a general-purpose LZ77 search.
+static const u16 lengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const u8 lengthExtra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const u16 distanceBase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const u8 distanceExtra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+// Huffman codes go most significant bit first, unlike everything else in deflate.
+static void writeCode(BitWriter& bits, u32 code, u32 length) {
+    u32 reversed = 0;
+    for (u32 i = 0; i < length; i++)
+        reversed |= (code >> i & 1) << (length - 1 - i);
+    bits.write(reversed, length);
+}
+
+static void writeSymbol(BitWriter& bits, u32 symbol) {
+    if (symbol < 144)       writeCode(bits, 0x30 + symbol, 8);
+    else if (symbol < 256)  writeCode(bits, 0x190 + symbol - 144, 9);
+    else if (symbol < 280)  writeCode(bits, symbol - 256, 7);
+    else                    writeCode(bits, 0xC0 + symbol - 280, 8);
+}
+
+static void deflate(const std::vector<u8>& data, usize rowStride, BitWriter& bits) {
+    bits.write(1, 1);   // final block
+    bits.write(1, 2);   // fixed Huffman codes
+
+    for (usize i = 0; i < data.size();) {
+        u32 best = 0;
+        usize bestDistance = 0;
+        for (usize distance: { (usize)1, rowStride }) {
+            if (distance > i || distance > 32768)
+                continue;
+            u32 length = 0;
+            while (length < 258 && i + length < data.size() && data[i + length] == data[i + length - distance])
+                length++;
+            if (length > best) {
+                best = length;
+                bestDistance = distance;
+            }
+        }
+
+        if (best < 3) {
+            writeSymbol(bits, data[i++]);
+            continue;
+        }
+
+        u32 code = 28;
+        while (lengthBase[code] > best)
+            code--;
+        writeSymbol(bits, 257 + code);
+        bits.write(best - lengthBase[code], lengthExtra[code]);
+
+        code = 29;
+        while (distanceBase[code] > bestDistance)
+            code--;
+        writeCode(bits, code, 5);
+        bits.write(bestDistance - distanceBase[code], distanceExtra[code]);
+        i += best;
+    }
+
+    writeSymbol(bits, 256);
+    bits.flush();
+}
+
+static u32 crc32(const u8* data, usize size, u32 crc) {
+    static const std::array<u32, 256> table = []() {
+        std::array<u32, 256> result;
+        for (u32 i = 0; i < 256; i++) {
+            u32 c = i;
+            for (u32 k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            result[i] = c;
+        }
+        return result;
+    }();
+
+    crc = ~crc;
+    for (usize i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void appendBigEndian(std::vector<u8>& out, u32 value) {
+    out.insert(out.end(), { (u8)(value >> 24), (u8)(value >> 16), (u8)(value >> 8), (u8)value });
+}
+
+static void appendChunk(std::vector<u8>& out, const char* type, const std::vector<u8>& data) {
+    appendBigEndian(out, data.size());
+    usize start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    appendBigEndian(out, crc32(&out[start], out.size() - start, 0));
+}
+
+bool Minimap::writePng(const char* path) const {
+    PROFILE_SCOPE("Minimap::writePng");
+    // Each row starts with filter type 0 (none).
+    usize stride = (usize)size.x + 1;
+    std::vector<u8> raw((usize)size.y * stride, 0);
+    for (i32 y = 0; y < size.y; y++)
+        std::copy_n(&types[(usize)y * size.x], size.x, &raw[y * stride + 1]);
+
+    BitWriter bits;
+    bits.bytes = { 0x78, 0x01 };
+    deflate(raw, stride, bits);
+
+    u32 a = 1, b = 0;
+    for (u8 byte: raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(bits.bytes, b << 16 | a);
+
+    std::vector<u8> header;
+    appendBigEndian(header, size.x);
+    appendBigEndian(header, size.y);
+    header.insert(header.end(), { 8, 3, 0, 0, 0 });     // 8-bit palette indices, no interlace
+
+    std::vector<u8> palette;
+    for (const auto& color: minimapColors)
+        palette.insert(palette.end(), color, color + 3);
+
+    std::vector<u8> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "PLTE", palette);
+    appendChunk(png, "IDAT", bits.bytes);
+    appendChunk(png, "IEND", {});
+
+    FILE* file = std::fopen(path, "wb");
+    if (!file) {
+        printf("Could not open %s for writing\n", path);
+        return false;
+    }
+    bool ok = std::fwrite(png.data(), 1, png.size(), file) == png.size();
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok)
+        printf("Could not write %s\n", path);
+    return ok;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+
+// Top-down overview of a level's tile grid, one pixel per `scale` x `scale` block
+// of cells. Each pixel shows the highest topmost tile type in its block; TileType
+// runs from the void through floors to walls and entrances, so room outlines stay
+// visible when downsampled. Pixels are kept both as tile types, for the palette
+// PNG, and as RGBA, ready for a texture upload.
+struct Minimap
+{
+    i32 scale;
+    sf::Vector2i size;
+    std::vector<u8> types;
+    std::vector<u8> pixels;
+    // Pixel rows [dirtyTop, dirtyBottom) changed since the last clearDirty().
+    i32 dirtyTop;
+    i32 dirtyBottom;
+
+    Minimap() = delete;
+    Minimap(i32 scale);
+
+    // Redraws the whole level, split into row bands over `threads` workers (0 = all cores).
+    void rasterize(const Level& level, u32 threads = 0);
+    // Redraws the pixel covering `cell` after a tile edit.
+    void update(const Level& level, sf::Vector2i cell);
+    bool dirty() const { return dirtyTop < dirtyBottom; }
+    void clearDirty() { dirtyTop = size.y; dirtyBottom = 0; }
+
+    void rasterizeRows(const Level& level, i32 top, i32 bottom);
+    void setPixel(usize index, u8 type);
+
+    // Indexed-color PNG, for looking over generated levels without a window.
+    bool writePng(const char* path) const;
+};
+
+// Minimap color of every tile type, as RGBA.
+extern const u8 minimapColors[TILE_TYPE_COUNT][4];
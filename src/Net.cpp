@@ -0,0 +1,252 @@
+#include "Net.hpp"
+
+BitReader remainingBits(const sf::Packet& packet) {
+    return BitReader(static_cast<const u8*>(packet.getData()) + packet.getReadPosition(),
+                     packet.getDataSize() - packet.getReadPosition());
+}
+
+void captureSnapshot(const PlayerManager& players, u32 tick, NetSnapshot& snapshot) {
+    snapshot.tick = tick;
+    snapshot.players.assign(players.slotToIndex.size(), NetPlayer());
+    for (u32 i = 0; i < players.size(); i++) {
+        NetPlayer& player = snapshot.players[players.slots[i]];
+        player.x = (i32)std::lround(players.positions[i].x * netPositionScale);
+        player.y = (i32)std::lround(players.positions[i].y * netPositionScale);
+        player.frame = players.frames[i];
+        player.present = true;
+    }
+}
+
+static const NetPlayer& playerAt(const NetSnapshot& snapshot, usize slot) {
+    static const NetPlayer absent;
+    return slot < snapshot.players.size() ? snapshot.players[slot] : absent;
+}
+
+bool sameSnapshot(const NetSnapshot& a, const NetSnapshot& b) {
+    usize slots = std::max(a.players.size(), b.players.size());
+    for (usize slot = 0; slot < slots; slot++)
+        if (playerAt(a, slot) != playerAt(b, slot))
+            return false;
+
+    return true;
+}
+
+void writeDelta(const NetSnapshot* base, const NetSnapshot& current, std::vector<NetPart>& parts) {
+    static const NetSnapshot empty;
+    if (!base)
+        base = &empty;
+
+    parts.clear();
+    parts.emplace_back();
+    i64 lastSlot = -1;
+    usize slots = std::max(base->players.size(), current.players.size());
+    for (usize slot = 0; slot < slots; slot++) {
+        const NetPlayer& before = playerAt(*base, slot);
+        const NetPlayer& now = playerAt(current, slot);
+        if (before == now)
+            continue;
+
+        // A player takes at most 19 bytes; start a new datagram before one could overflow.
+        if (parts.back().bits.size() + 20 > netPartBytes || parts.back().count == UINT16_MAX) {
+            parts.emplace_back();
+            lastSlot = -1;
+        }
+
+        NetPart& part = parts.back();
+        part.bits.writeVar((u32)(slot - lastSlot - 1));
+        part.bits.write(now.present, 1);
+        if (now.present) {
+            part.bits.writeSigned(now.x - (before.present ? before.x : 0));
+            part.bits.writeSigned(now.y - (before.present ? before.y : 0));
+            part.bits.writeVar(now.frame);
+        }
+        part.count++;
+        lastSlot = slot;
+    }
+
+    for (auto& part: parts)
+        part.bits.flush();
+}
+
+bool readDelta(BitReader& reader, u16 count, NetSnapshot& snapshot) {
+    i64 lastSlot = -1;
+    for (u16 i = 0; i < count; i++) {
+        usize slot = lastSlot + 1 + reader.readVar();
+        bool present = reader.read(1);
+        // Slots are dense from zero; a huge one is a corrupt datagram, not a player.
+        if (reader.failed || slot >= (1u << 24))
+            return false;
+
+        if (slot >= snapshot.players.size()) {
+            if (!present) {
+                lastSlot = slot;
+                continue;
+            }
+            snapshot.players.resize(slot + 1);
+        }
+
+        NetPlayer& player = snapshot.players[slot];
+        if (present) {
+            i32 x = reader.readSigned();
+            i32 y = reader.readSigned();
+            player.x = (player.present ? player.x : 0) + x;
+            player.y = (player.present ? player.y : 0) + y;
+            player.frame = reader.readVar();
+        }
+        player.present = present;
+        lastSlot = slot;
+    }
+
+    return !reader.failed;
+}
+
+static u32 bitsFor(u32 count) {
+    u32 bits = 1;
+    while ((u32(1) << bits) < count)
+        bits++;
+    return bits;
+}
+
+void writeLevel(sf::Packet& packet, const Level& level, bool seeded, const std::vector<TileChange>& edits) {
+    packet << level.mapSize.x << level.mapSize.y << level.tileSize.x << level.tileSize.y
+           << level.tilesetSize.x << level.tilesetSize.y << level.seed << level.maxRooms << level.maxAttempts
+           << seeded;
+
+    BitWriter bits;
+    if (!seeded) {
+        bits.writeSigned(level.center.position.x);
+        bits.writeSigned(level.center.position.y);
+        bits.writeVar(level.center.size.x);
+        bits.writeVar(level.center.size.y);
+        bits.writeVar(level.rooms.size());
+        for (const auto& room: level.rooms) {
+            bits.writeSigned(room.bounds.position.x);
+            bits.writeSigned(room.bounds.position.y);
+            bits.writeVar(room.bounds.size.x);
+            bits.writeVar(room.bounds.size.y);
+            bits.writeSigned(room.entrance.x);
+            bits.writeSigned(room.entrance.y);
+        }
+
+        // Runs of one type: most of a layer is space or empty.
+        u32 typeBits = bitsFor(TILE_TYPE_COUNT);
+        bits.writeVar(level.layers.size());
+        for (const auto& layer: level.layers) {
+            usize cells = layer.types.size();
+            for (usize start = 0; start < cells;) {
+                usize end = start + 1;
+                while (end < cells && layer.types[end] == layer.types[start])
+                    end++;
+                bits.write(layer.types[start], typeBits);
+                bits.writeVar((u32)(end - start - 1));
+                start = end;
+            }
+        }
+    }
+
+    writeTiles(bits, level, edits);
+    bits.flush();
+    packet.append(bits.bytes.data(), bits.bytes.size());
+}
+
+std::optional<Level> readLevel(sf::Packet& packet) {
+    sf::Vector2i mapSize;
+    sf::Vector2f tileSize, tilesetSize;
+    u64 seed;
+    u32 maxRooms, maxAttempts;
+    bool seeded;
+    if (!(packet >> mapSize.x >> mapSize.y >> tileSize.x >> tileSize.y >> tilesetSize.x >> tilesetSize.y
+                 >> seed >> maxRooms >> maxAttempts >> seeded)
+        || mapSize.x <= 0 || mapSize.y <= 0 || mapSize.x > 1 << 16 || mapSize.y > 1 << 16)
+        return std::nullopt;
+
+    Level level(mapSize, tileSize, tilesetSize);
+    level.maxRooms = maxRooms;
+    level.maxAttempts = maxAttempts;
+    BitReader bits = remainingBits(packet);
+    if (seeded) {
+        level.generate(seed);
+    } else {
+        level.seed = seed;
+        level.center.position.x = bits.readSigned();
+        level.center.position.y = bits.readSigned();
+        level.center.size.x = bits.readVar();
+        level.center.size.y = bits.readVar();
+        u32 rooms = bits.readVar();
+        for (u32 i = 0; i < rooms && !bits.failed; i++) {
+            RoomInfo room;
+            room.bounds.position.x = bits.readSigned();
+            room.bounds.position.y = bits.readSigned();
+            room.bounds.size.x = bits.readVar();
+            room.bounds.size.y = bits.readVar();
+            room.entrance.x = bits.readSigned();
+            room.entrance.y = bits.readSigned();
+            level.rooms.push_back(room);
+        }
+
+        u32 typeBits = bitsFor(TILE_TYPE_COUNT);
+        u32 layers = bits.readVar();
+        for (u32 i = 0; i < layers && !bits.failed; i++) {
+            Layer layer(mapSize);
+            usize cells = layer.types.size();
+            for (usize start = 0; start < cells && !bits.failed;) {
+                u8 type = bits.read(typeBits);
+                usize end = start + 1 + bits.readVar();
+                if (end > cells || type >= TILE_TYPE_COUNT)
+                    return std::nullopt;
+                std::fill(layer.types.begin() + start, layer.types.begin() + end, type);
+                start = end;
+            }
+            level.layers.push_back(std::move(layer));
+        }
+    }
+
+    if (bits.failed || level.layers.empty() || !readTiles(bits, level))
+        return std::nullopt;
+
+    // The receiver gets the whole level; the edits are part of it, not news.
+    level.dirtyCells.clear();
+    return level;
+}
+
+void writeTiles(BitWriter& bits, const Level& level, const std::vector<TileChange>& cells) {
+    u32 typeBits = bitsFor(TILE_TYPE_COUNT);
+    bits.writeVar(cells.size());
+    for (const auto& change: cells) {
+        const Layer& layer = level.layers[change.layer];
+        bits.writeVar(change.cell.x);
+        bits.writeVar(change.cell.y);
+        bits.writeVar(change.layer);
+        bits.write(layer.getType(change.cell), typeBits);
+        bits.write(layer.getFlags(change.cell), 8);
+
+        sf::Color tint = layer.getTint(change.cell);
+        bits.write(tint != sf::Color::White, 1);
+        if (tint != sf::Color::White)
+            bits.write(tint.toInteger(), 32);
+    }
+}
+
+bool readTiles(BitReader& bits, Level& level) {
+    u32 typeBits = bitsFor(TILE_TYPE_COUNT);
+    u32 count = bits.readVar();
+    for (u32 i = 0; i < count; i++) {
+        TileChange change;
+        change.cell.x = bits.readVar();
+        change.cell.y = bits.readVar();
+        change.layer = bits.readVar();
+        u8 type = bits.read(typeBits);
+        u8 flags = bits.read(8);
+        sf::Color tint = bits.read(1) ? sf::Color(bits.read(32)) : sf::Color::White;
+        if (bits.failed || !level.contains(change.cell) || change.layer >= level.layers.size() || type >= TILE_TYPE_COUNT)
+            return false;
+
+        Layer& layer = level.layers[change.layer];
+        layer.setType(change.cell, static_cast<TileType>(type));
+        layer.setFlags(change.cell, flags);
+        layer.setTint(change.cell, tint);
+        level.dirtyCells.push_back(change);
+    }
+
+    return true;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "pch.hpp"
+#include "BitStream.hpp"
+#include "Level.hpp"
+#include "PlayerManager.hpp"
+#include <SFML/Network.hpp>
+#include <optional>
+
+// Wire format shared by Server and NetClient. TCP carries the handshake, the level
+// and every tile edit, reliably and in order. UDP carries the players: every tick the
+// server sends what changed since the snapshot a client last acknowledged, split
+// into datagrams that each stay under one MTU.
+enum NetMessage : u8
+{
+    NET_HELLO = 1,  // client -> server, TCP: protocol, client UDP port
+    NET_LEVEL,      // server -> client, TCP: client id, server UDP port, generation, level, edits
+    NET_TILES,      // server -> client, TCP: generation, edited cells
+    NET_SNAPSHOT,   // server -> client, UDP: generation, tick, base tick, part, parts, count, players
+    NET_ACK,        // client -> server, UDP: client id, generation, tick
+};
+
+constexpr u32 netProtocol = 1;
+// Snapshots each end keeps as delta baselines; an ack older than this gets a full snapshot.
+constexpr u32 netHistory = 32;
+constexpr u32 netNoTick = ~0u;
+// Positions travel as fixed point with this many steps per pixel.
+constexpr f32 netPositionScale = 8.f;
+// Bit-packed players per snapshot datagram, so the datagram fits a 1500 byte MTU.
+constexpr usize netPartBytes = 1200;
+
+// A player as the network sees it, filed under its PlayerManager slot.
+struct NetPlayer
+{
+    i32 x = 0, y = 0;
+    u8 frame = 0;
+    bool present = false;
+
+    bool operator==(const NetPlayer& other) const {
+        return present == other.present && (!present || (x == other.x && y == other.y && frame == other.frame));
+    }
+    bool operator!=(const NetPlayer& other) const { return !(*this == other); }
+};
+
+struct NetSnapshot
+{
+    u32 tick = netNoTick;
+    // By slot; slots past the end are empty.
+    std::vector<NetPlayer> players;
+};
+
+// Bits of a packet after the fields already extracted with >>.
+BitReader remainingBits(const sf::Packet& packet);
+
+// One datagram worth of changed players.
+struct NetPart
+{
+    BitWriter bits;
+    u16 count = 0;
+};
+
+void captureSnapshot(const PlayerManager& players, u32 tick, NetSnapshot& snapshot);
+bool sameSnapshot(const NetSnapshot& a, const NetSnapshot& b);
+
+// Encodes the players of `current` that differ from `base` (all of them without one).
+// Positions of players the base already had go as deltas. Always yields at least one
+// part, so an unchanged tick still reaches the client and gets acknowledged.
+void writeDelta(const NetSnapshot* base, const NetSnapshot& current, std::vector<NetPart>& parts);
+// Applies `count` players from one part onto `snapshot`, which starts out as the base.
+bool readDelta(BitReader& reader, u16 count, NetSnapshot& snapshot);
+
+// The level by seed when `seeded` (the client generates it itself), otherwise every
+// layer run-length packed; then the current state of each cell in `edits`.
+void writeLevel(sf::Packet& packet, const Level& level, bool seeded, const std::vector<TileChange>& edits);
+std::optional<Level> readLevel(sf::Packet& packet);
+
+// Type, flags and tint of the given cells, applied raw on the other end and
+// recorded in its dirtyCells, since the server already did the autotiling.
+void writeTiles(BitWriter& bits, const Level& level, const std::vector<TileChange>& cells);
+bool readTiles(BitReader& bits, Level& level);
@@ -0,0 +1,148 @@
+#include "NetClient.hpp"
+
+NetClient::NetClient(sf::IpAddress _server):
+    server(_server),
+    serverUdpPort(0),
+    id(0),
+    generation(0),
+    latest(netNoTick),
+    partsMissing(0),
+    assemblingValid(false),
+    bytesReceived(0),
+    snapshotsCompleted(0),
+    snapshotsDropped(0)
+{}
+
+bool NetClient::connect(u16 tcpPort) {
+    if (udp.bind(sf::Socket::AnyPort) != sf::Socket::Status::Done) {
+        printf("Could not bind a UDP port\n");
+        return false;
+    }
+
+    if (tcp.connect(server, tcpPort, sf::seconds(5.f)) != sf::Socket::Status::Done) {
+        printf("Could not connect to %s:%u\n", server.toString().c_str(), tcpPort);
+        return false;
+    }
+
+    sf::Packet hello;
+    hello << (u8)NET_HELLO << netProtocol << udp.getLocalPort();
+    if (tcp.send(hello) != sf::Socket::Status::Done)
+        return false;
+
+    tcp.setBlocking(false);
+    udp.setBlocking(false);
+    return true;
+}
+
+void NetClient::update() {
+    sf::Packet packet;
+    while (true) {
+        sf::Socket::Status status = tcp.receive(packet);
+        if (status != sf::Socket::Status::Done)
+            break;
+        bytesReceived += packet.getDataSize() + 4;
+        if (!handleReliable(packet))
+            printf("Client %u: bad message from the server\n", id);
+    }
+
+    std::optional<sf::IpAddress> address;
+    u16 port;
+    while (udp.receive(packet, address, port) == sf::Socket::Status::Done) {
+        if (address != server || port != serverUdpPort)
+            continue;
+        bytesReceived += packet.getDataSize() + 28;
+        handleSnapshot(packet);
+    }
+}
+
+bool NetClient::handleReliable(sf::Packet& packet) {
+    u8 type;
+    u32 messageGeneration;
+    if (!(packet >> type))
+        return false;
+
+    if (type == NET_LEVEL) {
+        if (!(packet >> id >> serverUdpPort >> messageGeneration))
+            return false;
+
+        level = readLevel(packet);
+        generation = messageGeneration;
+        latest = netNoTick;
+        assembling.tick = netNoTick;
+        assemblingValid = false;
+        for (auto& snapshot: history)
+            snapshot.tick = netNoTick;
+        return level.has_value();
+    }
+
+    if (type == NET_TILES) {
+        if (!(packet >> messageGeneration) || !level)
+            return false;
+        // Edits made before a level change the client already has the result of.
+        if (messageGeneration != generation)
+            return true;
+
+        BitReader bits = remainingBits(packet);
+        return readTiles(bits, *level);
+    }
+
+    return false;
+}
+
+void NetClient::handleSnapshot(sf::Packet& packet) {
+    u8 type;
+    u32 messageGeneration, tick, baseTick;
+    u16 part, parts, count;
+    if (!(packet >> type >> messageGeneration >> tick >> baseTick >> part >> parts >> count)
+        || type != NET_SNAPSHOT || messageGeneration != generation || !level || part >= parts)
+        return;
+
+    // Older than what we have or are building: reordered, nothing to learn from it.
+    if (latest != netNoTick && tick <= latest)
+        return;
+    if (assembling.tick != netNoTick && tick < assembling.tick)
+        return;
+
+    if (tick != assembling.tick || !assemblingValid) {
+        if (tick == assembling.tick)
+            return;
+
+        assembling.tick = tick;
+        assemblingValid = true;
+        if (baseTick == netNoTick) {
+            assembling.players.clear();
+        } else if (history[baseTick % netHistory].tick == baseTick) {
+            assembling.players = history[baseTick % netHistory].players;
+        } else {
+            assemblingValid = false;
+            snapshotsDropped++;
+            return;
+        }
+        partsReceived.assign(parts, false);
+        partsMissing = parts;
+    }
+
+    if (part >= partsReceived.size() || partsReceived[part])
+        return;
+
+    BitReader bits = remainingBits(packet);
+    if (!readDelta(bits, count, assembling)) {
+        assemblingValid = false;
+        snapshotsDropped++;
+        return;
+    }
+    partsReceived[part] = true;
+    if (--partsMissing)
+        return;
+
+    NetSnapshot& done = history[tick % netHistory];
+    done.tick = tick;
+    done.players = assembling.players;
+    latest = tick;
+    assemblingValid = false;
+    snapshotsCompleted++;
+
+    sf::Packet ack;
+    ack << (u8)NET_ACK << id << generation << tick;
+    (void)udp.send(ack, server, serverUdpPort);
+}
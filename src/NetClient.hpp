@@ -0,0 +1,47 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Net.hpp"
+#include <array>
+
+// Mirror of a Server's world: the level as the server sent it, kept current by
+// its tile edits, and the players of the newest complete snapshot. Snapshots
+// arrive as deltas in one or more datagrams; once all parts of one are in it is
+// kept as a baseline and acknowledged, so the next delta can build on it.
+struct NetClient
+{
+    sf::TcpSocket tcp;
+    sf::UdpSocket udp;
+    sf::IpAddress server;
+    u16 serverUdpPort;
+
+    u32 id;
+    u32 generation;
+    std::optional<Level> level;
+
+    std::array<NetSnapshot, netHistory> history;
+    // Tick of the newest complete snapshot, or netNoTick.
+    u32 latest;
+    // Snapshot being put together from its datagrams; abandoned if a newer one starts.
+    NetSnapshot assembling;
+    std::vector<bool> partsReceived;
+    u16 partsMissing;
+    bool assemblingValid;
+
+    u64 bytesReceived;
+    u64 snapshotsCompleted;
+    // Deltas whose baseline was no longer around, or that did not decode.
+    u64 snapshotsDropped;
+
+    NetClient() = delete;
+    NetClient(sf::IpAddress server);
+
+    // Connects and says hello; the level follows during update().
+    bool connect(u16 tcpPort);
+    void update();
+    bool ready() const { return level.has_value() && latest != netNoTick; }
+    const NetSnapshot& snapshot() const { return history[latest % netHistory]; }
+
+    bool handleReliable(sf::Packet& packet);
+    void handleSnapshot(sf::Packet& packet);
+};
@@ -0,0 +1,243 @@
+#include "Pathfinding.hpp"
+#include "Profiler.hpp"
+#include <atomic>
+#include <thread>
+
+const sf::Vector2i NavGrid::directions[8] = {
+    { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 },
+    { 1, 1 }, { -1, -1 }, { 1, -1 }, { -1, 1 }
+};
+
+static constexpr u32 straightCost = 10;
+static constexpr u32 diagonalCost = 14;
+
+static u32 stepCost(u8 direction) { return direction < 4 ? straightCost : diagonalCost; }
+
+// Octile distance, the exact cost on an empty 8-way grid.
+static u32 heuristic(sf::Vector2i a, sf::Vector2i b) {
+    u32 dx = std::abs(a.x - b.x);
+    u32 dy = std::abs(a.y - b.y);
+    return straightCost * std::max(dx, dy) + (diagonalCost - straightCost) * std::min(dx, dy);
+}
+
+// Min-heap on the first element.
+static bool heapOrder(const std::pair<u32, u32>& a, const std::pair<u32, u32>& b) { return a.first > b.first; }
+
+void PathScratch::prepare(usize cells) {
+    if (stamps.size() != cells) {
+        cost.assign(cells, 0);
+        parent.assign(cells, 0);
+        stamps.assign(cells, 0);
+        stamp = 0;
+    }
+
+    // Wrapping would make stale stamps look current.
+    if (++stamp == 0) {
+        std::fill(stamps.begin(), stamps.end(), 0);
+        stamp = 1;
+    }
+    open.clear();
+}
+
+sf::Vector2i FlowField::next(sf::Vector2i cell) const {
+    if (cell.x < 0 || cell.y < 0 || cell.x >= size.x || cell.y >= size.y)
+        return cell;
+
+    u8 step = direction[(usize)cell.y * size.x + cell.x];
+    return step == none ? cell : cell + NavGrid::directions[step];
+}
+
+NavGrid::NavGrid(const Level& level):
+    size(level.mapSize),
+    walkable(sf::IntRect({ 0, 0 }, level.mapSize))
+{
+    for (i32 y = 0; y < size.y; y++)
+        for (i32 x = 0; x < size.x; x++)
+            update(level, { x, y });
+}
+
+void NavGrid::update(const Level& level, sf::Vector2i cell) {
+    if (!level.contains(cell))
+        return;
+
+    // The topmost tile decides: walls on the room layer cover the ground.
+    i32 layer = level.topLayer(cell);
+    walkable.set(cell, layer >= 0 && walkableType(level.layers[layer].getType(cell)));
+}
+
+bool NavGrid::walkableType(TileType type) {
+    switch (type) {
+        case SPACE:
+        case CENTER:
+        case ROOM:
+        case ENTRANCE_LEFT:
+        case ENTRANCE_RIGHT:
+        case ENTRANCE_UP:
+        case ENTRANCE_DOWN:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool NavGrid::canStep(sf::Vector2i cell, u8 direction) const {
+    sf::Vector2i step = directions[direction];
+    if (!isWalkable(cell + step))
+        return false;
+
+    return direction < 4 || (isWalkable({ cell.x + step.x, cell.y }) && isWalkable({ cell.x, cell.y + step.y }));
+}
+
+bool NavGrid::findPath(sf::Vector2i start, sf::Vector2i goal, std::vector<sf::Vector2i>& path, PathScratch& scratch) const {
+    path.clear();
+    if (!isWalkable(start) || !isWalkable(goal))
+        return false;
+
+    scratch.prepare((usize)size.x * size.y);
+    u32 stamp = scratch.stamp;
+    u32 startIndex = offset(start);
+    u32 goalIndex = offset(goal);
+
+    scratch.cost[startIndex] = 0;
+    scratch.parent[startIndex] = startIndex;
+    scratch.stamps[startIndex] = stamp;
+    scratch.open.push_back({ heuristic(start, goal), startIndex });
+
+    while (!scratch.open.empty()) {
+        std::pop_heap(scratch.open.begin(), scratch.open.end(), heapOrder);
+        auto [estimate, index] = scratch.open.back();
+        scratch.open.pop_back();
+
+        if (index == goalIndex)
+            break;
+
+        sf::Vector2i cell(index % size.x, index / size.x);
+        u32 cost = scratch.cost[index];
+        // Skip entries left behind when a cheaper route to the cell was found.
+        if (estimate > cost + heuristic(cell, goal))
+            continue;
+
+        for (u8 d = 0; d < 8; d++) {
+            if (!canStep(cell, d))
+                continue;
+
+            sf::Vector2i neighbor = cell + directions[d];
+            u32 neighborIndex = offset(neighbor);
+            u32 neighborCost = cost + stepCost(d);
+            if (scratch.stamps[neighborIndex] == stamp && scratch.cost[neighborIndex] <= neighborCost)
+                continue;
+
+            scratch.stamps[neighborIndex] = stamp;
+            scratch.cost[neighborIndex] = neighborCost;
+            scratch.parent[neighborIndex] = index;
+            scratch.open.push_back({ neighborCost + heuristic(neighbor, goal), neighborIndex });
+            std::push_heap(scratch.open.begin(), scratch.open.end(), heapOrder);
+        }
+    }
+
+    if (scratch.stamps[goalIndex] != stamp)
+        return false;
+
+    for (u32 index = goalIndex; ; index = scratch.parent[index]) {
+        path.emplace_back(index % size.x, index / size.x);
+        if (index == startIndex)
+            break;
+    }
+    std::reverse(path.begin(), path.end());
+    return true;
+}
+
+void NavGrid::buildFlowField(const std::vector<sf::Vector2i>& goals, FlowField& field, PathScratch& scratch) const {
+    PROFILE_SCOPE("NavGrid::buildFlowField");
+    usize cells = (usize)size.x * size.y;
+    field.size = size;
+    field.goals = goals;
+    field.distance.assign(cells, FlowField::unreachable);
+    field.direction.assign(cells, FlowField::none);
+
+    // Dijkstra outwards from every goal at once.
+    scratch.prepare(cells);
+    for (const auto& goal: goals) {
+        if (!isWalkable(goal))
+            continue;
+        field.distance[offset(goal)] = 0;
+        scratch.open.push_back({ 0, offset(goal) });
+    }
+    std::make_heap(scratch.open.begin(), scratch.open.end(), heapOrder);
+
+    while (!scratch.open.empty()) {
+        std::pop_heap(scratch.open.begin(), scratch.open.end(), heapOrder);
+        auto [distance, index] = scratch.open.back();
+        scratch.open.pop_back();
+        if (distance > field.distance[index])
+            continue;
+
+        sf::Vector2i cell(index % size.x, index / size.x);
+        for (u8 d = 0; d < 8; d++) {
+            // Steps are symmetric, so walking the field backwards is the same as forwards.
+            if (!canStep(cell, d))
+                continue;
+
+            u32 neighborIndex = offset(cell + directions[d]);
+            u32 neighborDistance = distance + stepCost(d);
+            if (neighborDistance >= field.distance[neighborIndex])
+                continue;
+
+            field.distance[neighborIndex] = neighborDistance;
+            // The neighbor steps back towards this cell: the opposite direction.
+            field.direction[neighborIndex] = d ^ 1;
+            scratch.open.push_back({ neighborDistance, neighborIndex });
+            std::push_heap(scratch.open.begin(), scratch.open.end(), heapOrder);
+        }
+    }
+}
+
+FlowFieldCache::FlowFieldCache(const NavGrid& _grid, usize _capacity):
+    grid(_grid),
+    capacity(_capacity)
+{}
+
+const FlowField& FlowFieldCache::get(const std::vector<sf::Vector2i>& goals) {
+    for (auto it = fields.begin(); it != fields.end(); it++) {
+        if (it->goals == goals) {
+            fields.splice(fields.begin(), fields, it);
+            return fields.front();
+        }
+    }
+
+    // Reuse the least recently used field's buffers when full.
+    if (fields.size() >= capacity)
+        fields.splice(fields.begin(), fields, std::prev(fields.end()));
+    else
+        fields.emplace_front();
+
+    grid.buildFlowField(goals, fields.front(), scratch);
+    return fields.front();
+}
+
+void findPaths(const NavGrid& grid, const std::vector<PathQuery>& queries,
+               std::vector<std::vector<sf::Vector2i>>& paths, std::vector<PathScratch>& scratch,
+               u32 threads) {
+    PROFILE_SCOPE("findPaths");
+    paths.resize(queries.size());
+    std::atomic<usize> next(0);
+
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::min<usize>(threads, std::max<usize>(queries.size() / 16, 1));
+    if (scratch.size() < threads)
+        scratch.resize(threads);
+
+    auto worker = [&](u32 index) {
+        for (usize i = next++; i < queries.size(); i = next++)
+            grid.findPath(queries[i].start, queries[i].goal, paths[i], scratch[index]);
+    };
+
+    std::vector<std::thread> workers;
+    for (u32 i = 1; i < threads; i++)
+        workers.emplace_back(worker, i);
+
+    worker(0);
+    for (auto& thread: workers)
+        thread.join();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+#include <list>
+
+// Per-thread working memory for path searches, reused between queries so a
+// warmed-up search does not allocate. Cells are marked with a stamp instead of
+// clearing the arrays for every query.
+struct PathScratch
+{
+    std::vector<u32> cost;
+    std::vector<u32> parent;
+    std::vector<u32> stamps;
+    std::vector<std::pair<u32, u32>> open;
+    u32 stamp = 0;
+
+    void prepare(usize cells);
+};
+
+// Distance to the nearest goal for every reachable cell, and the neighbor to step
+// to from each cell. One field serves any number of agents heading to the same goals.
+struct FlowField
+{
+    static constexpr u8 none = 8;
+    static constexpr u32 unreachable = ~0u;
+
+    sf::Vector2i size;
+    std::vector<sf::Vector2i> goals;
+    std::vector<u32> distance;
+    std::vector<u8> direction;
+
+    // Cell to move to from `cell`; `cell` itself at a goal or where no goal is reachable.
+    sf::Vector2i next(sf::Vector2i cell) const;
+};
+
+struct PathQuery
+{
+    sf::Vector2i start;
+    sf::Vector2i goal;
+};
+
+// Walkability of a level's tile grid with A* for single queries and flow fields
+// for shared goals. Moves are 8-way; diagonals may not cut a blocked corner.
+// Costs are 10 per straight step and 14 per diagonal one. Directions come in
+// opposite pairs, so d ^ 1 reverses direction d.
+struct NavGrid
+{
+    static const sf::Vector2i directions[8];
+
+    sf::Vector2i size;
+    Bitmap walkable;
+
+    NavGrid() = delete;
+    NavGrid(const Level& level);
+
+    static bool walkableType(TileType type);
+    // Re-reads one cell after the level changed it.
+    void update(const Level& level, sf::Vector2i cell);
+    bool isWalkable(sf::Vector2i cell) const { return walkable.get(cell); }
+    bool canStep(sf::Vector2i cell, u8 direction) const;
+    u32 offset(sf::Vector2i cell) const { return (u32)cell.y * size.x + cell.x; }
+
+    // Fills `path` from start to goal inclusive. Returns false, leaving `path`
+    // empty, if either end is blocked or the goal is unreachable.
+    bool findPath(sf::Vector2i start, sf::Vector2i goal, std::vector<sf::Vector2i>& path, PathScratch& scratch) const;
+
+    void buildFlowField(const std::vector<sf::Vector2i>& goals, FlowField& field, PathScratch& scratch) const;
+};
+
+// Keeps the most recently used flow fields so agents sharing a goal share one
+// computation. Not thread-safe; build fields up front to share them across threads.
+struct FlowFieldCache
+{
+    const NavGrid& grid;
+    usize capacity;
+    std::list<FlowField> fields;
+    PathScratch scratch;
+
+    FlowFieldCache() = delete;
+    FlowFieldCache(const NavGrid& grid, usize capacity = 16);
+
+    const FlowField& get(const std::vector<sf::Vector2i>& goals);
+    void clear() { fields.clear(); }
+};
+
+// Answers every query, spread over `threads` workers (0 = all cores), worker i
+// searching with scratch[i]. Keep `scratch` between batches so workers reuse
+// their buffers. paths[i] belongs to queries[i] and is empty if unreachable.
+void findPaths(const NavGrid& grid, const std::vector<PathQuery>& queries,
+               std::vector<std::vector<sf::Vector2i>>& paths, std::vector<PathScratch>& scratch,
+               u32 threads = 0);
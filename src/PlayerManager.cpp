@@ -1,29 +1,172 @@
 #include "PlayerManager.hpp"
+#include "Profiler.hpp"
 
-PlayerManager::PlayerManager()
-{
+PlayerManager::PlayerManager(sf::Vector2i _frameSize, f32 _rowHeight, u8 _animations, sf::Time _animationTime):
+    frameSize(_frameSize),
+    rowHeight(_rowHeight),
+    animations(_animations),
+    animationTime(_animationTime)
+{}
 
+void PlayerManager::update(sf::Time dt) {
+    PROFILE_SCOPE("PlayerManager::update");
+
+    // Every player animates at the same rate, so one accumulator drives them all
+    // and the per-player work is a plain loop over bytes.
+    animationAccumulator += dt;
+    u32 steps = animationAccumulator / animationTime;
+    if (steps == 0)
+        return;
+
+    animationAccumulator -= animationTime * (f32)steps;
+    u8 advance = steps % animations;
+    u8 count = animations;
+    u8* frame = frames.data();
+    for (usize i = 0; i < frames.size(); i++) {
+        u8 next = frame[i] + advance;
+        frame[i] = next >= count ? next - count : next;
+    }
+}
+
+PlayerHandle PlayerManager::addPlayer(sf::Vector2f pos) {
+    u32 slot;
+    if (freeSlots.empty()) {
+        slot = slotToIndex.size();
+        slotToIndex.push_back(0);
+        generations.push_back(0);
+    } else {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    }
+
+    u32 index = positions.size();
+    slotToIndex[slot] = index;
+    positions.push_back(pos);
+    frames.push_back(0);
+    slots.push_back(slot);
+    depths.push_back(0);
+    bucketPositions.push_back(0);
+    fileUnder(index, depthOf(pos));
+
+    return PlayerHandle { slot, generations[slot] };
+}
+
+void PlayerManager::removePlayer(PlayerHandle handle) {
+    if (!valid(handle))
+        return;
+
+    u32 index = slotToIndex[handle.slot];
+    u32 last = positions.size() - 1;
+    unfile(index);
+
+    positions[index] = positions[last];
+    frames[index] = frames[last];
+    slots[index] = slots[last];
+    depths[index] = depths[last];
+    bucketPositions[index] = bucketPositions[last];
+    slotToIndex[slots[index]] = index;
+
+    positions.pop_back();
+    frames.pop_back();
+    slots.pop_back();
+    depths.pop_back();
+    bucketPositions.pop_back();
+
+    generations[handle.slot]++;
+    freeSlots.push_back(handle.slot);
+}
+
+bool PlayerManager::valid(PlayerHandle handle) const {
+    return handle.slot < generations.size() && generations[handle.slot] == handle.generation;
+}
+
+sf::Vector2f PlayerManager::getPosition(PlayerHandle handle) const {
+    return positions[slotToIndex[handle.slot]];
 }
 
-void PlayerManager::draw(sf::RenderTarget& target, sf::RenderStates states) const {
-    for (auto player: players)
-        target.draw(player->sprite, states);
+void PlayerManager::setPosition(PlayerHandle handle, sf::Vector2f pos) {
+    u32 index = slotToIndex[handle.slot];
+    positions[index] = pos;
+
+    i32 depth = depthOf(pos);
+    if (depth != depths[index]) {
+        unfile(index);
+        fileUnder(index, depth);
+    }
 }
 
-void PlayerManager::update() {
-    for (auto player: players) {
-        if (player->animation.getElapsedTime() > player->animationTime) {
-            sf::IntRect rect = player->sprite.getTextureRect();
-            rect.position.x = (rect.position.x + rect.size.x) % (rect.size.x * player->animations);
-            player->sprite.setTextureRect(rect);
+void PlayerManager::assign(const std::vector<sf::Vector2f>& _positions, const std::vector<u8>& _frames) {
+    usize count = _positions.size();
+    positions = _positions;
+    frames = _frames;
+    slots.resize(count);
+    depths.resize(count);
+    bucketPositions.resize(count);
+    slotToIndex.resize(count);
+    generations.assign(count, 0);
+    freeSlots.clear();
+
+    for (auto& [depth, bucket]: buckets)
+        bucket.clear();
 
-            player->animation.restart();
-        }
+    for (u32 i = 0; i < count; i++) {
+        slots[i] = i;
+        slotToIndex[i] = i;
+        fileUnder(i, depthOf(positions[i]));
     }
 }
 
-void PlayerManager::addPlayer(sf::Texture& texture, sf::Vector2f pos, sf::Vector2i size) {
-    Player* player = new Player(texture, sf::IntRect({ 0, 0 }, size));
-    player->sprite.setPosition(pos);
-    players.push_back(player);
+i32 PlayerManager::depthOf(sf::Vector2f pos) const {
+    // Isometric row (x + y) under the player's feet. Rows are rowHeight apart on
+    // screen; feet sit one tile height above the sprite's bottom edge, matching
+    // how Game places the pointer.
+    return (i32)std::floor((pos.y + frameSize.y) / rowHeight) - 2;
+}
+
+const std::vector<u32>* PlayerManager::playersAtDepth(i32 depth) const {
+    auto bucket = buckets.find(depth);
+    return bucket == buckets.end() || bucket->second.empty() ? nullptr : &bucket->second;
+}
+
+void PlayerManager::fileUnder(u32 index, i32 depth) {
+    std::vector<u32>& bucket = buckets[depth];
+    depths[index] = depth;
+    bucketPositions[index] = bucket.size();
+    bucket.push_back(slots[index]);
+}
+
+void PlayerManager::unfile(u32 index) {
+    std::vector<u32>& bucket = buckets[depths[index]];
+    u32 position = bucketPositions[index];
+
+    bucket[position] = bucket.back();
+    bucketPositions[slotToIndex[bucket[position]]] = position;
+    bucket.pop_back();
+}
+
+void PlayerManager::appendQuads(sf::FloatRect screen, std::vector<sf::Vertex>& vertices) const {
+    for (u32 i = 0; i < positions.size(); i++)
+        appendQuad(i, screen, vertices);
+}
+
+void PlayerManager::appendQuads(i32 depth, sf::FloatRect screen, std::vector<sf::Vertex>& vertices) const {
+    if (const std::vector<u32>* players = playersAtDepth(depth))
+        for (u32 slot: *players)
+            appendQuad(slotToIndex[slot], screen, vertices);
+}
+
+void PlayerManager::appendQuad(u32 index, sf::FloatRect screen, std::vector<sf::Vertex>& vertices) const {
+    sf::Vector2f size(frameSize);
+    sf::Vector2f pos = positions[index];
+    if (pos.x + size.x < screen.position.x || pos.x > screen.position.x + screen.size.x
+        || pos.y + size.y < screen.position.y || pos.y > screen.position.y + screen.size.y)
+        return;
+
+    sf::Vector2f texture(frames[index] * size.x, 0.f);
+    sf::Vertex topLeft      { pos,                          sf::Color::White, texture };
+    sf::Vertex topRight     { pos + sf::Vector2f(size.x, 0), sf::Color::White, texture + sf::Vector2f(size.x, 0) };
+    sf::Vertex bottomLeft   { pos + sf::Vector2f(0, size.y), sf::Color::White, texture + sf::Vector2f(0, size.y) };
+    sf::Vertex bottomRight  { pos + size,                   sf::Color::White, texture + size };
+
+    vertices.insert(vertices.end(), { topLeft, topRight, bottomLeft, bottomLeft, topRight, bottomRight });
 }
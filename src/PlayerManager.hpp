@@ -2,29 +2,58 @@
 
 #include "pch.hpp"
 
-struct Player
+// Stable reference to a player; stays valid while other players are added or removed.
+struct PlayerHandle
 {
-    sf::Sprite sprite;
-    sf::Time animationTime;
-    u32 animations;
-    sf::Clock animation;
-
-    Player() = delete;
-    Player(sf::Texture& texture, sf::IntRect rect):
-        sprite(texture, rect),
-        animationTime(sf::seconds(0.1)),
-        animations(6)
-    {}
+    u32 slot;
+    u32 generation;
 };
 
-struct PlayerManager : public sf::Drawable
+// Players stored as parallel arrays, kept dense by swapping the last player into
+// a removed one's place. Handles go through a slot table so they survive that.
+// Each player is also filed under its isometric depth row so the renderer can
+// interleave them with walls; moving only re-files players whose row changed.
+struct PlayerManager
 {
-    std::vector<Player*> players;
+    std::vector<sf::Vector2f> positions;
+    std::vector<u8> frames;
+    std::vector<u32> slots;
+    std::vector<i32> depths;
+    std::vector<u32> bucketPositions;
+    std::unordered_map<i32, std::vector<u32>> buckets;
+
+    std::vector<u32> slotToIndex;
+    std::vector<u32> generations;
+    std::vector<u32> freeSlots;
+
+    sf::Vector2i frameSize;
+    f32 rowHeight;
+    u8 animations;
+    sf::Time animationTime;
+    sf::Time animationAccumulator;
+
+    PlayerManager() = delete;
+    PlayerManager(sf::Vector2i frameSize, f32 rowHeight, u8 animations = 6, sf::Time animationTime = sf::seconds(0.1f));
+
+    void update(sf::Time dt);
+
+    PlayerHandle addPlayer(sf::Vector2f pos);
+    void removePlayer(PlayerHandle handle);
+    bool valid(PlayerHandle handle) const;
+    sf::Vector2f getPosition(PlayerHandle handle) const;
+    void setPosition(PlayerHandle handle, sf::Vector2f pos);
+    // Replaces every player with the given dense arrays and files them in one pass.
+    // Earlier handles become meaningless; meant for render-side mirrors.
+    void assign(const std::vector<sf::Vector2f>& positions, const std::vector<u8>& frames);
+    usize size() const { return positions.size(); }
 
-    PlayerManager();
+    i32 depthOf(sf::Vector2f pos) const;
+    const std::vector<u32>* playersAtDepth(i32 depth) const;
 
-    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
-    void update();
+    void appendQuads(sf::FloatRect screen, std::vector<sf::Vertex>& vertices) const;
+    void appendQuads(i32 depth, sf::FloatRect screen, std::vector<sf::Vertex>& vertices) const;
+    void appendQuad(u32 index, sf::FloatRect screen, std::vector<sf::Vertex>& vertices) const;
 
-    void addPlayer(sf::Texture& texture, sf::Vector2f pos, sf::Vector2i size);
+    void fileUnder(u32 index, i32 depth);
+    void unfile(u32 index);
 };
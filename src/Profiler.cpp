@@ -0,0 +1,92 @@
+#include "Profiler.hpp"
+#include <thread>
+
+Profiler::Profiler():
+    enabled(false),
+    events(eventCapacity),
+    nextEvent(0),
+    frameTimes(frameCapacity, 0.f),
+    nextFrame(0),
+    missedTicks(0),
+    epoch(std::chrono::steady_clock::now())
+{}
+
+Profiler& Profiler::get() {
+    static Profiler profiler;
+    return profiler;
+}
+
+u64 Profiler::now() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+u32 Profiler::threadIndex() {
+    static std::atomic<u32> threads(0);
+    thread_local u32 index = threads++;
+    return index;
+}
+
+void Profiler::record(const char* name, u64 start, u64 end) {
+    u32 thread = threadIndex();
+    std::lock_guard<std::mutex> lock(mutex);
+    events[nextEvent % eventCapacity] = ProfileEvent { name, start, end - start, thread };
+    nextEvent++;
+}
+
+void Profiler::recordFrame(f32 milliseconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    frameTimes[nextFrame % frameCapacity] = milliseconds;
+    nextFrame++;
+}
+
+void Profiler::recordMissedTick() {
+    std::lock_guard<std::mutex> lock(mutex);
+    missedTicks++;
+}
+
+FrameStats Profiler::frameStats() {
+    std::vector<f32> sorted;
+    FrameStats stats = {};
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sorted.assign(frameTimes.begin(), frameTimes.begin() + std::min(nextFrame, frameCapacity));
+        stats.missedTicks = missedTicks;
+    }
+
+    stats.frames = sorted.size();
+    if (sorted.empty())
+        return stats;
+
+    std::sort(sorted.begin(), sorted.end());
+    stats.p50 = sorted[sorted.size() / 2];
+    stats.p99 = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+    stats.max = sorted.back();
+    return stats;
+}
+
+bool Profiler::writeChromeTrace(const std::string& path) {
+    std::vector<ProfileEvent> snapshot;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        usize count = std::min(nextEvent, eventCapacity);
+        for (usize i = nextEvent - count; i < nextEvent; i++)
+            snapshot.push_back(events[i % eventCapacity]);
+    }
+
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        printf("Could not write %s\n", path.c_str());
+        return false;
+    }
+
+    std::fprintf(file, "{\"traceEvents\":[\n");
+    for (usize i = 0; i < snapshot.size(); i++) {
+        const ProfileEvent& event = snapshot[i];
+        std::fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":1,\"tid\":%u}%s\n",
+            event.name, (unsigned long long)event.start, (unsigned long long)event.duration, event.thread,
+            i + 1 < snapshot.size() ? "," : "");
+    }
+    std::fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    std::fclose(file);
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "pch.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+// Lightweight built-in profiler. Scoped timers cost a single relaxed load when
+// profiling is off; when on, each scope appends one event to a fixed ring buffer
+// that can be dumped as a Chrome trace (chrome://tracing, Perfetto).
+struct ProfileEvent
+{
+    const char* name;
+    u64 start;
+    u64 duration;
+    u32 thread;
+};
+
+struct FrameStats
+{
+    f32 p50;
+    f32 p99;
+    f32 max;
+    u32 frames;
+    u32 missedTicks;
+};
+
+struct Profiler
+{
+    static constexpr usize eventCapacity = 1 << 16;
+    static constexpr usize frameCapacity = 1024;
+
+    std::atomic<bool> enabled;
+    std::mutex mutex;
+    std::vector<ProfileEvent> events;
+    usize nextEvent;
+    std::vector<f32> frameTimes;
+    usize nextFrame;
+    u32 missedTicks;
+    std::chrono::steady_clock::time_point epoch;
+
+    Profiler();
+
+    static Profiler& get();
+
+    u64 now() const;
+    u32 threadIndex();
+    void record(const char* name, u64 start, u64 end);
+    void recordFrame(f32 milliseconds);
+    void recordMissedTick();
+    FrameStats frameStats();
+    bool writeChromeTrace(const std::string& path);
+};
+
+struct ScopedTimer
+{
+    const char* name;
+    u64 start;
+
+    ScopedTimer(const char* _name):
+        name(Profiler::get().enabled.load(std::memory_order_relaxed) ? _name : nullptr),
+        start(name ? Profiler::get().now() : 0)
+    {}
+
+    ~ScopedTimer() {
+        if (name)
+            Profiler::get().record(name, start, Profiler::get().now());
+    }
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(name)
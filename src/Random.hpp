@@ -0,0 +1,45 @@
+#pragma once
+
+#include "pch.hpp"
+
+// Small seedable generator (xoshiro128**) so every level owns its own stream.
+// Unlike rand() it is thread-safe per instance and gives the same sequence on
+// every platform for a given seed.
+struct Rng
+{
+    u32 state[4];
+
+    Rng(u64 seed = 0) { reseed(seed); }
+
+    void reseed(u64 seed) {
+        // splitmix64 spreads the seed so nearby seeds give unrelated streams.
+        for (u32 i = 0; i < 4; i += 2) {
+            seed += 0x9E3779B97F4A7C15ull;
+            u64 z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            z ^= z >> 31;
+            state[i] = (u32)z;
+            state[i + 1] = (u32)(z >> 32);
+        }
+    }
+
+    u32 next() {
+        u32 result = rotl(state[1] * 5, 7) * 9;
+        u32 t = state[1] << 9;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 11);
+
+        return result;
+    }
+
+    // Uniform-enough integer in [0, bound), like rand() % bound.
+    i32 operator()(u32 bound) { return (i32)(next() % bound); }
+
+    static u32 rotl(u32 x, i32 k) { return (x << k) | (x >> (32 - k)); }
+};
@@ -0,0 +1,250 @@
+#include "Server.hpp"
+#include "Profiler.hpp"
+#include <chrono>
+
+Server::Server(Simulation& _simulation, f32 _bytesPerSecond):
+    simulation(_simulation),
+    bytesPerSecond(_bytesPerSecond),
+    generation(0)
+{
+    listener.setBlocking(false);
+    udp.setBlocking(false);
+}
+
+bool Server::listen(u16 port) {
+    if (listener.listen(port) != sf::Socket::Status::Done) {
+        printf("Could not listen on TCP port %u\n", port);
+        return false;
+    }
+
+    if (udp.bind(port) != sf::Socket::Status::Done) {
+        printf("Could not bind UDP port %u\n", port);
+        return false;
+    }
+
+    printf("Serving on TCP port %u, UDP port %u\n", listener.getLocalPort(), udp.getLocalPort());
+    return true;
+}
+
+void Server::update() {
+    PROFILE_SCOPE("Server::update");
+    auto start = std::chrono::steady_clock::now();
+    stats = ServerStats();
+
+    accept();
+    receive();
+    sendLevelChanges();
+    sendSnapshots();
+    for (auto& peer: peers)
+        if (peer.tcp)
+            flush(peer);
+
+    stats.seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Server::accept() {
+    while (true) {
+        auto socket = std::make_unique<sf::TcpSocket>();
+        if (listener.accept(*socket) != sf::Socket::Status::Done)
+            return;
+
+        socket->setBlocking(false);
+        NetPeer peer;
+        peer.address = socket->getRemoteAddress();
+        peer.tcp = std::move(socket);
+        peer.udpPort = 0;
+        peer.ackTick = netNoTick;
+        peer.ackGeneration = 0;
+        peer.allowance = 0.f;
+        peer.bytesSent = 0;
+        peers.push_back(std::move(peer));
+    }
+}
+
+void Server::receive() {
+    for (u32 id = 0; id < peers.size(); id++) {
+        NetPeer& peer = peers[id];
+        sf::Packet packet;
+        while (peer.tcp) {
+            sf::Socket::Status status = peer.tcp->receive(packet);
+            if (status == sf::Socket::Status::Disconnected || status == sf::Socket::Status::Error) {
+                drop(peer);
+                break;
+            }
+            if (status != sf::Socket::Status::Done)
+                break;
+
+            u8 type;
+            u32 protocol;
+            u16 udpPort;
+            if (!(packet >> type >> protocol >> udpPort) || type != NET_HELLO || protocol != netProtocol || peer.udpPort) {
+                printf("Dropping client %u: bad hello\n", id);
+                drop(peer);
+                break;
+            }
+
+            peer.udpPort = udpPort;
+            sf::Packet level;
+            level << (u8)NET_LEVEL << id << udp.getLocalPort() << generation;
+            writeLevel(level, simulation.level, simulation.levelSeeded, edits);
+            send(peer, level);
+        }
+    }
+
+    sf::Packet packet;
+    std::optional<sf::IpAddress> address;
+    u16 port;
+    while (udp.receive(packet, address, port) == sf::Socket::Status::Done) {
+        u8 type;
+        u32 id, ackGeneration, tick;
+        if (!(packet >> type >> id >> ackGeneration >> tick) || type != NET_ACK || id >= peers.size()
+            || ackGeneration != generation)
+            continue;
+
+        // Only the client's own address may move its baseline.
+        NetPeer& peer = peers[id];
+        if (!peer.tcp || peer.udpPort != port || peer.address != address)
+            continue;
+
+        if (peer.ackGeneration != generation || peer.ackTick == netNoTick || tick > peer.ackTick) {
+            peer.ackGeneration = ackGeneration;
+            peer.ackTick = tick;
+        }
+    }
+}
+
+void Server::sendLevelChanges() {
+    Level& level = simulation.level;
+    if (simulation.levelReplaced) {
+        simulation.levelReplaced = false;
+        level.dirtyCells.clear();
+        generation++;
+        edits.clear();
+        editedCells.clear();
+        for (auto& snapshot: history)
+            snapshot.tick = netNoTick;
+
+        for (u32 id = 0; id < peers.size(); id++) {
+            if (!peers[id].tcp || !peers[id].udpPort)
+                continue;
+            sf::Packet packet;
+            packet << (u8)NET_LEVEL << id << udp.getLocalPort() << generation;
+            writeLevel(packet, level, simulation.levelSeeded, edits);
+            send(peers[id], packet);
+        }
+        return;
+    }
+
+    if (level.dirtyCells.empty())
+        return;
+
+    // One change per cell, in the state it ended the tick in.
+    std::vector<TileChange> changed;
+    std::unordered_set<u64> seen;
+    for (const auto& change: level.dirtyCells) {
+        u64 key = (u64)change.layer << 32 | level.layers[change.layer].offset(change.cell);
+        if (seen.insert(key).second)
+            changed.push_back(change);
+        if (editedCells.insert(key).second)
+            edits.push_back(change);
+    }
+    level.dirtyCells.clear();
+
+    BitWriter bits;
+    writeTiles(bits, level, changed);
+    bits.flush();
+    sf::Packet packet;
+    packet << (u8)NET_TILES << generation;
+    packet.append(bits.bytes.data(), bits.bytes.size());
+    for (auto& peer: peers)
+        if (peer.tcp && peer.udpPort)
+            send(peer, packet);
+}
+
+void Server::sendSnapshots() {
+    u32 tick = (u32)simulation.ticks;
+    NetSnapshot& current = history[tick % netHistory];
+    captureSnapshot(simulation.playerManager, tick, current);
+
+    f32 perTick = bytesPerSecond / tickRate;
+    // A quarter second of burst, and always room for one full datagram.
+    f32 burst = std::max(bytesPerSecond / 4.f, (f32)netPartBytes + 64.f);
+    encoded.clear();
+    for (u32 id = 0; id < peers.size(); id++) {
+        NetPeer& peer = peers[id];
+        if (!peer.tcp || !peer.udpPort)
+            continue;
+
+        peer.allowance = std::min(peer.allowance + perTick, burst);
+        if (peer.allowance <= 0.f) {
+            stats.snapshotsSkipped++;
+            continue;
+        }
+
+        u32 baseTick = netNoTick;
+        if (peer.ackGeneration == generation && peer.ackTick != netNoTick && peer.ackTick < tick
+            && history[peer.ackTick % netHistory].tick == peer.ackTick)
+            baseTick = peer.ackTick;
+
+        auto [it, inserted] = encoded.try_emplace(baseTick);
+        if (inserted) {
+            writeDelta(baseTick == netNoTick ? nullptr : &history[baseTick % netHistory], current, parts);
+            for (u16 i = 0; i < parts.size(); i++) {
+                sf::Packet& packet = it->second.emplace_back();
+                packet << (u8)NET_SNAPSHOT << generation << tick << baseTick << i << (u16)parts.size() << parts[i].count;
+                packet.append(parts[i].bits.bytes.data(), parts[i].bits.bytes.size());
+            }
+            stats.deltasEncoded++;
+        }
+
+        for (auto& packet: it->second) {
+            // A full socket buffer drops the datagram like the network would.
+            if (udp.send(packet, *peer.address, peer.udpPort) != sf::Socket::Status::Done)
+                continue;
+            // Payload plus UDP and IPv4 headers.
+            usize bytes = packet.getDataSize() + 28;
+            peer.allowance -= bytes;
+            peer.bytesSent += bytes;
+            stats.udpBytes += bytes;
+            stats.datagrams++;
+        }
+        stats.snapshotsSent++;
+    }
+}
+
+void Server::send(NetPeer& peer, const sf::Packet& packet) {
+    peer.outbox.push_back(packet);
+}
+
+void Server::flush(NetPeer& peer) {
+    while (!peer.outbox.empty()) {
+        sf::Packet& packet = peer.outbox.front();
+        // The size prefix SFML adds, plus TCP and IPv4 headers per MTU sized segment.
+        usize bytes = packet.getDataSize() + 4 + 40 * (packet.getDataSize() / 1460 + 1);
+        sf::Socket::Status status = peer.tcp->send(packet);
+        if (status == sf::Socket::Status::Partial || status == sf::Socket::Status::NotReady)
+            return;
+        if (status != sf::Socket::Status::Done) {
+            drop(peer);
+            return;
+        }
+
+        peer.outbox.pop_front();
+        peer.allowance -= bytes;
+        peer.bytesSent += bytes;
+        stats.tcpBytes += bytes;
+    }
+}
+
+void Server::drop(NetPeer& peer) {
+    peer.tcp.reset();
+    peer.outbox.clear();
+    peer.udpPort = 0;
+}
+
+usize Server::connected() const {
+    usize count = 0;
+    for (const auto& peer: peers)
+        count += peer.tcp && peer.udpPort;
+    return count;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Net.hpp"
+#include "Simulation.hpp"
+#include <array>
+#include <deque>
+#include <memory>
+#include <unordered_map>
+
+struct NetPeer
+{
+    std::unique_ptr<sf::TcpSocket> tcp;
+    // Reliable messages not yet taken by the socket; the front may be half sent.
+    std::deque<sf::Packet> outbox;
+    std::optional<sf::IpAddress> address;
+    // Zero until the client said hello.
+    u16 udpPort;
+    u32 ackTick;
+    u32 ackGeneration;
+    // Bytes the client may still be sent; refilled every tick up to a burst.
+    f32 allowance;
+    u64 bytesSent;
+};
+
+// Totals for one Server::update.
+struct ServerStats
+{
+    u64 tcpBytes = 0;
+    u64 udpBytes = 0;
+    u32 datagrams = 0;
+    u32 snapshotsSent = 0;
+    // Snapshots held back because the client was over its bandwidth.
+    u32 snapshotsSkipped = 0;
+    // Distinct baselines encoded; clients acking the same tick share the bytes.
+    u32 deltasEncoded = 0;
+    f64 seconds = 0.0;
+};
+
+// Authoritative server for a Simulation: clients join over TCP and get the level,
+// by seed when it came from one, then tile edits as they happen. Players go out
+// over UDP each tick as a delta against the last snapshot the client acknowledged,
+// so a client that keeps up only receives what moved. Each client is held to
+// `bytesPerSecond`; snapshots it cannot afford are skipped and the next delta
+// covers them.
+struct Server
+{
+    static constexpr f32 tickRate = 60.f;
+
+    Simulation& simulation;
+    sf::TcpListener listener;
+    sf::UdpSocket udp;
+    // Dropped peers keep their place, so a client id indexes this directly.
+    std::vector<NetPeer> peers;
+    f32 bytesPerSecond;
+
+    // Bumped when the level is replaced; snapshots and acks of older ones are ignored.
+    u32 generation;
+    std::array<NetSnapshot, netHistory> history;
+    // Cells edited since the level was replaced, for clients that join later.
+    std::vector<TileChange> edits;
+    std::unordered_set<u64> editedCells;
+    // This tick's encoded deltas by base tick.
+    std::unordered_map<u32, std::vector<sf::Packet>> encoded;
+    std::vector<NetPart> parts;
+
+    ServerStats stats;
+
+    Server() = delete;
+    // Attach before the simulation's first tick, so no edit goes unseen.
+    Server(Simulation& simulation, f32 bytesPerSecond);
+
+    // Listens for TCP and UDP on `port`, or on any free ports if it is 0.
+    bool listen(u16 port);
+    u16 tcpPort() const { return listener.getLocalPort(); }
+
+    // Call after each simulation tick. Takes over level.dirtyCells and levelReplaced
+    // from the simulation, since the server is what consumes them here.
+    void update();
+
+    void accept();
+    void receive();
+    void sendLevelChanges();
+    void sendSnapshots();
+    void send(NetPeer& peer, const sf::Packet& packet);
+    void flush(NetPeer& peer);
+    void drop(NetPeer& peer);
+    usize connected() const;
+};
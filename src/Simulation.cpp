@@ -0,0 +1,222 @@
+#include "Simulation.hpp"
+#include "LevelFile.hpp"
+#include "Profiler.hpp"
+
+static const char* snapshotPath = "out/level.grk";
+static constexpr f32 minZoom = 0.25f;
+
+Simulation::Simulation(sf::Vector2i mapSize, const char* levelPath):
+    level(mapSize, { 32, 16 }, { 32, 32 }),
+    playerManager({ 32, 48 }, level.tileSize.y / 2),
+    navGrid(level),
+    playerHash(level),
+    visibility(level),
+    camera(0.f, 0.f),
+    zoom(1.f),
+    viewSize(640.f, 400.f),
+    highlightedLayer(-1),
+    running(true),
+    asyncGeneration(true),
+    verbose(true),
+    snapshots(true),
+    ticks(0),
+    levelReplaced(false),
+    levelSeeded(false)
+{
+    if (!levelPath || !loadSnapshot(levelPath))
+        regenerate(0);
+    addPlayer({ 0, 300 });
+}
+
+PlayerHandle Simulation::addPlayer(sf::Vector2f pos) {
+    PlayerHandle handle = playerManager.addPlayer(pos);
+    playerHash.insert(handle.slot, feetOf(pos));
+    visibility.setViewer(handle.slot, playerHash.cellOf(feetOf(pos)), viewRadius);
+    return handle;
+}
+
+void Simulation::movePlayer(PlayerHandle handle, sf::Vector2f delta) {
+    if (!playerManager.valid(handle))
+        return;
+
+    sf::Vector2f pos = playerManager.getPosition(handle);
+    sf::Vector2f feet = feetOf(pos);
+    sf::Vector2f moved = resolveWalls(navGrid, playerHash, feet, feet + delta);
+    playerManager.setPosition(handle, pos + (moved - feet));
+    playerHash.move(handle.slot, moved);
+    visibility.setViewer(handle.slot, playerHash.cellOf(moved), viewRadius);
+}
+
+sf::Vector2f Simulation::feetOf(sf::Vector2f pos) const {
+    // Bottom middle of the sprite, which depthOf also treats as the feet.
+    return pos + sf::Vector2f(playerManager.frameSize.x / 2.f, (f32)playerManager.frameSize.y);
+}
+
+void Simulation::toggleWall(sf::Vector2i cell) {
+    if (level.layers.size() < 2 || !level.contains(cell))
+        return;
+
+    usize firstChange = level.dirtyCells.size();
+    level.setTileType(1, cell, level.layers[1].getType(cell) == EMPTY ? ROOM : EMPTY);
+    for (usize i = firstChange; i < level.dirtyCells.size(); i++) {
+        navGrid.update(level, level.dirtyCells[i].cell);
+        visibility.tileChanged(level, level.dirtyCells[i].cell);
+    }
+
+    // A wall may have been put down on the highlighted cell's layer.
+    if (highlightedLayer >= 0 && cell == highlightedIndex && level.topLayer(cell) != highlightedLayer) {
+        level.setTileFlags(highlightedLayer, cell, level.layers[highlightedLayer].getFlags(cell) & ~TILE_HIGHLIGHTED);
+        highlightedLayer = -1;
+    }
+}
+
+f32 Simulation::maxZoom() const {
+    // The map's diamond spans (width + height) / 2 tiles each way on screen.
+    sf::Vector2f extent = level.tileSize * ((level.mapSize.x + level.mapSize.y) / 2.f);
+    return std::max(1.f, 1.25f * std::max(extent.x / viewSize.x, extent.y / viewSize.y));
+}
+
+u64 Simulation::stateHash() const {
+    // FNV-1a over the raw bytes; replays run the same binary, so floats are compared exactly.
+    u64 hash = 0xCBF29CE484222325ull;
+    auto mix = [&](const void* data, usize size) {
+        const u8* bytes = static_cast<const u8*>(data);
+        for (usize i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 0x100000001B3ull;
+        }
+    };
+
+    mix(&ticks, sizeof(ticks));
+    mix(&camera, sizeof(camera));
+    mix(&zoom, sizeof(zoom));
+    mix(&pointerCell, sizeof(pointerCell));
+    mix(&highlightedLayer, sizeof(highlightedLayer));
+    mix(&highlightedIndex, sizeof(highlightedIndex));
+    mix(&level.seed, sizeof(level.seed));
+    mix(playerManager.positions.data(), playerManager.positions.size() * sizeof(sf::Vector2f));
+    mix(playerManager.frames.data(), playerManager.frames.size());
+
+    for (const auto& change: level.dirtyCells) {
+        const Layer& layer = level.layers[change.layer];
+        u8 tile[2] = { layer.types[layer.offset(change.cell)], layer.getFlags(change.cell) };
+        mix(&change.cell, sizeof(change.cell));
+        mix(&change.layer, sizeof(change.layer));
+        mix(tile, sizeof(tile));
+    }
+
+    if (levelReplaced) {
+        u64 levelHash = level.hash();
+        mix(&levelHash, sizeof(levelHash));
+    }
+
+    return hash;
+}
+
+void Simulation::regenerate(u64 seed) {
+    generator.cancel();
+    level.generate(seed);
+    levelSeeded = true;
+    levelChanged();
+}
+
+bool Simulation::loadSnapshot(const char* path) {
+    std::optional<Level> loaded = loadLevel(path);
+    if (!loaded)
+        return false;
+
+    generator.cancel();
+    level = std::move(*loaded);
+    levelSeeded = false;
+    levelChanged();
+    return true;
+}
+
+void Simulation::levelChanged() {
+    levelReplaced = true;
+    navGrid = NavGrid(level);
+    visibility.reset(level);
+    level.dirtyCells.clear();
+    highlightedLayer = -1;
+    zoom = std::min(zoom, maxZoom());
+
+    if (verbose)
+        printf("Level %dx%d seed %llu: %.2f MB\n", level.mapSize.x, level.mapSize.y,
+            (unsigned long long)level.seed, level.memoryUsage() / (1024.f * 1024.f));
+}
+
+void Simulation::update(sf::Time dt, const InputState& input) {
+    PROFILE_SCOPE("Simulation::update");
+    if (generator.poll(level)) {
+        levelSeeded = true;
+        levelChanged();
+        if (verbose)
+            printf("Generated seed %llu in %.2f ms\n", (unsigned long long)level.seed, generator.latency.asSeconds() * 1000.f);
+    }
+
+    playerManager.update(dt);
+
+    f32 panSpeed = 600.f * dt.asSeconds();
+    if (input.pan != sf::Vector2f())
+        camera += input.pan.normalized() * panSpeed;
+
+    sf::Vector2f halfTileSize = level.tilesetSize.componentWiseDiv({ 2, 2 });
+    pointerCell = level.screenToMap(input.pointer - halfTileSize);
+
+    for (const auto& event: input.events)
+        handle(event);
+    visibility.update();
+
+    ticks++;
+}
+
+void Simulation::handle(const InputEvent& event) {
+    f32 zoomSpeed = -0.1f;
+
+    switch (event.action) {
+        case ACTION_QUIT:
+            running = false;
+            break;
+
+        case ACTION_REGENERATE:
+            if (!asyncGeneration)
+                regenerate(level.seed + 1);
+            else if (!generator.busy)
+                generator.request(level, level.seed + 1);
+            break;
+
+        case ACTION_SAVE:
+            if (snapshots && saveLevel(level, snapshotPath))
+                printf("Saved %s\n", snapshotPath);
+            break;
+
+        case ACTION_LOAD:
+            if (snapshots)
+                loadSnapshot(snapshotPath);
+            break;
+
+        case ACTION_ZOOM:
+            zoom = std::clamp(zoom * (1.f + event.value * zoomSpeed), minZoom, maxZoom());
+            break;
+
+        case ACTION_SELECT:
+            if (highlightedLayer >= 0) {
+                const Layer& layer = level.layers[highlightedLayer];
+                level.setTileFlags(highlightedLayer, highlightedIndex, layer.getFlags(highlightedIndex) & ~TILE_HIGHLIGHTED);
+            }
+
+            highlightedIndex = { pointerCell.x + 1, pointerCell.y + 1 };
+            if ((highlightedLayer = level.topLayer(highlightedIndex)) >= 0) {
+                const Layer& layer = level.layers[highlightedLayer];
+                level.setTileFlags(highlightedLayer, highlightedIndex, layer.getFlags(highlightedIndex) | TILE_HIGHLIGHTED);
+            }
+            break;
+
+        case ACTION_TOGGLE_WALL:
+            toggleWall({ pointerCell.x + 1, pointerCell.y + 1 });
+            break;
+
+        default:
+            break;
+    }
+}
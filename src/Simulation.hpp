@@ -0,0 +1,78 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Input.hpp"
+#include "Level.hpp"
+#include "LevelGenerator.hpp"
+#include "Pathfinding.hpp"
+#include "PlayerManager.hpp"
+#include "SpatialHash.hpp"
+#include "Visibility.hpp"
+
+// Game state and the per-tick rules that change it, with no window or textures.
+// Game drives it from live input and draws it; the headless runner drives it
+// from an InputSource as fast as it can.
+struct Simulation
+{
+    static constexpr i32 viewRadius = 12;
+
+    Level level;
+    LevelGenerator generator;
+    PlayerManager playerManager;
+    NavGrid navGrid;
+    // Players by slot, filed at their feet.
+    SpatialHash playerHash;
+    // What the players can see, each player a viewer under its slot.
+    Visibility visibility;
+
+    sf::Vector2f camera;
+    f32 zoom;
+    // Size of the view at zoom 1, which bounds how far out zooming may go.
+    sf::Vector2f viewSize;
+    sf::Vector2i pointerCell;
+    // Layer of the highlighted tile, or -1.
+    i32 highlightedLayer;
+    sf::Vector2i highlightedIndex;
+
+    bool running;
+    bool asyncGeneration;
+    // Prints a line for every level change; off for headless runs that regenerate often.
+    bool verbose;
+    // Lets save and load actions touch the snapshot file. Off while input is
+    // recorded or replayed: a replay would overwrite the snapshot, or load
+    // whatever is on disk by then.
+    bool snapshots;
+    u64 ticks;
+
+    // Set when the level was swapped out; tile edits land in level.dirtyCells.
+    // Whoever draws the level clears both once it has caught up.
+    bool levelReplaced;
+    // Set when the level came from its seed rather than a file, so a copy can be
+    // regenerated from the seed instead of shipped tile by tile.
+    bool levelSeeded;
+
+    Simulation() = delete;
+    Simulation(sf::Vector2i mapSize, const char* levelPath = nullptr);
+
+    void update(sf::Time dt, const InputState& input);
+    void handle(const InputEvent& event);
+
+    PlayerHandle addPlayer(sf::Vector2f pos);
+    // Moves a player by `delta`, sliding along walls instead of entering them.
+    void movePlayer(PlayerHandle handle, sf::Vector2f delta);
+    sf::Vector2f feetOf(sf::Vector2f pos) const;
+    // Adds or removes a room-layer tile, reshaping the walls around it.
+    void toggleWall(sf::Vector2i cell);
+
+    // Zoom at which the whole map fits in the view.
+    f32 maxZoom() const;
+
+    // Fingerprint of the state after a tick: camera, pointer, players and the tiles
+    // edited this tick, so call it before level.dirtyCells is consumed. Whole levels
+    // are only hashed when replaced, since that is too slow per tick on big maps.
+    u64 stateHash() const;
+
+    void regenerate(u64 seed);
+    bool loadSnapshot(const char* path);
+    void levelChanged();
+};
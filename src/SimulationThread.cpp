@@ -0,0 +1,120 @@
+#include "SimulationThread.hpp"
+#include "Profiler.hpp"
+
+WorldSnapshot::WorldSnapshot():
+    tick(0),
+    running(true),
+    zoom(1.f),
+    firstEdit(0),
+    levelFirstEdit(0)
+{}
+
+SimulationThread::SimulationThread(Simulation& _simulation, sf::Time _tickTime):
+    simulation(_simulation),
+    tickTime(_tickTime),
+    snapshots(WorldSnapshot()),
+    firstEdit(0),
+    levelFirstEdit(0),
+    appliedEdits(0),
+    quit(false)
+{
+    snapshots.back().previousPositions = simulation.playerManager.positions;
+    publish(simulation.camera);
+    worker = std::thread(&SimulationThread::run, this);
+}
+
+SimulationThread::~SimulationThread() {
+    quit = true;
+    worker.join();
+}
+
+void SimulationThread::pushInput(const InputState& _input) {
+    std::lock_guard<std::mutex> lock(inputMutex);
+    pendingInput.pan = _input.pan;
+    pendingInput.pointer = _input.pointer;
+    pendingInput.events.insert(pendingInput.events.end(), _input.events.begin(), _input.events.end());
+}
+
+void SimulationThread::acknowledge(u64 sequence) {
+    appliedEdits.store(sequence, std::memory_order_release);
+}
+
+void SimulationThread::run() {
+    sf::Time next = clock.getElapsedTime();
+
+    while (!quit && simulation.running) {
+        sf::Time now = clock.getElapsedTime();
+        if (now < next) {
+            sf::sleep(next - now);
+            continue;
+        }
+
+        // Catch up on late ticks, but drop them rather than spiral when far behind.
+        next += tickTime;
+        if (now - next > tickTime * 4.f)
+            next = now;
+        if (now > next)
+            Profiler::get().recordMissedTick();
+
+        tick();
+    }
+}
+
+void SimulationThread::tick() {
+    PROFILE_SCOPE("SimulationThread::tick");
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        input.pan = pendingInput.pan;
+        input.pointer = pendingInput.pointer;
+        input.events.swap(pendingInput.events);
+        pendingInput.events.clear();
+    }
+
+    WorldSnapshot& snapshot = snapshots.back();
+    sf::Vector2f previousCamera = simulation.camera;
+    snapshot.previousPositions = simulation.playerManager.positions;
+
+    simulation.update(tickTime, input);
+    publish(previousCamera);
+}
+
+void SimulationThread::publish(sf::Vector2f previousCamera) {
+    u64 applied = appliedEdits.load(std::memory_order_acquire);
+    if (applied > firstEdit) {
+        usize done = std::min<u64>(applied - firstEdit, edits.size());
+        edits.erase(edits.begin(), edits.begin() + done);
+        firstEdit += done;
+    }
+
+    if (simulation.levelReplaced || !level) {
+        simulation.level.dirtyCells.clear();
+        level = std::make_shared<Level>(simulation.level);
+        firstEdit += edits.size();
+        levelFirstEdit = firstEdit;
+        edits.clear();
+        simulation.levelReplaced = false;
+    }
+
+    for (const auto& change: simulation.level.dirtyCells) {
+        const Layer& layer = simulation.level.layers[change.layer];
+        edits.push_back({ change.cell, (u8)change.layer, layer.getType(change.cell),
+                          layer.getFlags(change.cell), layer.getTint(change.cell) });
+    }
+    simulation.level.dirtyCells.clear();
+
+    WorldSnapshot& snapshot = snapshots.back();
+    snapshot.tick = simulation.ticks;
+    snapshot.publishedAt = clock.getElapsedTime();
+    snapshot.running = simulation.running;
+    snapshot.previousCamera = previousCamera;
+    snapshot.camera = simulation.camera;
+    snapshot.zoom = simulation.zoom;
+    snapshot.pointerCell = simulation.pointerCell;
+    snapshot.positions = simulation.playerManager.positions;
+    snapshot.frames = simulation.playerManager.frames;
+    snapshot.level = level;
+    snapshot.edits = edits;
+    snapshot.firstEdit = firstEdit;
+    snapshot.levelFirstEdit = levelFirstEdit;
+    snapshots.publish();
+}
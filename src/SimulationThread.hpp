@@ -0,0 +1,90 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Simulation.hpp"
+#include "TripleBuffer.hpp"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// The state of one changed tile after a tick.
+struct TileEdit
+{
+    sf::Vector2i cell;
+    u8 layer;
+    TileType type;
+    u8 flags;
+    sf::Color tint;
+};
+
+// Everything the renderer needs from one simulation tick. Positions from the
+// start of the tick are kept next to the final ones so frames between ticks
+// can be interpolated. Players are only the dense arrays; the renderer files
+// them into depth rows itself.
+struct WorldSnapshot
+{
+    u64 tick;
+    sf::Time publishedAt;
+    bool running;
+
+    sf::Vector2f previousCamera;
+    sf::Vector2f camera;
+    f32 zoom;
+    sf::Vector2i pointerCell;
+
+    std::vector<sf::Vector2f> positions;
+    std::vector<sf::Vector2f> previousPositions;
+    std::vector<u8> frames;
+
+    // Copy of the level made when it was replaced. After publishing only the
+    // render thread touches it, applying edits to its tiles.
+    std::shared_ptr<Level> level;
+    // Tile edits the renderer has not acknowledged yet. Edits are numbered;
+    // edits[i] has sequence number firstEdit + i, and levelFirstEdit is the
+    // first one made on `level`.
+    std::vector<TileEdit> edits;
+    u64 firstEdit;
+    u64 levelFirstEdit;
+
+    WorldSnapshot();
+};
+
+// Ticks a Simulation at a fixed rate on its own thread. The render thread pushes
+// input in and takes the newest WorldSnapshot out; neither waits on the other.
+// The Simulation must not be touched from elsewhere while this runs.
+struct SimulationThread
+{
+    Simulation& simulation;
+    sf::Time tickTime;
+    TripleBuffer<WorldSnapshot> snapshots;
+    std::shared_ptr<Level> level;
+
+    // Edits are kept until the renderer acknowledges them, so snapshots it
+    // skips lose nothing and the list stays as short as the render latency.
+    std::vector<TileEdit> edits;
+    u64 firstEdit;
+    u64 levelFirstEdit;
+    std::atomic<u64> appliedEdits;
+
+    std::mutex inputMutex;
+    InputState pendingInput;
+    InputState input;
+
+    sf::Clock clock;
+    std::atomic<bool> quit;
+    std::thread worker;
+
+    SimulationThread() = delete;
+    SimulationThread(Simulation& simulation, sf::Time tickTime);
+    ~SimulationThread();
+
+    // Render thread: replaces the held pan and pointer and queues the events for the next tick.
+    void pushInput(const InputState& input);
+    // Render thread: every edit numbered below `sequence` has been applied.
+    void acknowledge(u64 sequence);
+
+    void run();
+    void tick();
+    void publish(sf::Vector2f previousCamera);
+};
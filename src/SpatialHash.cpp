@@ -0,0 +1,201 @@
+#include "SpatialHash.hpp"
+
+SpatialHash::SpatialHash(Level& _level):
+    level(&_level),
+    count(0),
+    emptyCells(0)
+{}
+
+sf::Vector2i SpatialHash::cellOf(sf::Vector2f point) const {
+    // Same mapping as the pointer: a sprite's diamond is centered half a tileset tile in.
+    return level->screenToMap(point - level->tilesetSize.componentWiseDiv({ 2, 2 }));
+}
+
+void SpatialHash::insert(u32 id, sf::Vector2f point) {
+    if (id >= bucketPositions.size()) {
+        positions.resize(id + 1);
+        cellKeys.resize(id + 1);
+        bucketPositions.resize(id + 1, absent);
+    }
+    if (bucketPositions[id] != absent)
+        remove(id);
+
+    auto [found, added] = cells.try_emplace(key(cellOf(point)));
+    std::vector<u32>& bucket = found->second;
+    if (!added && bucket.empty())
+        emptyCells--;
+    positions[id] = point;
+    cellKeys[id] = key(cellOf(point));
+    bucketPositions[id] = bucket.size();
+    bucket.push_back(id);
+    count++;
+}
+
+void SpatialHash::remove(u32 id) {
+    if (!contains(id))
+        return;
+
+    std::vector<u32>& bucket = cells[cellKeys[id]];
+    u32 position = bucketPositions[id];
+    bucket[position] = bucket.back();
+    bucketPositions[bucket[position]] = position;
+    bucket.pop_back();
+    bucketPositions[id] = absent;
+    count--;
+
+    if (bucket.empty() && ++emptyCells > count) {
+        for (auto it = cells.begin(); it != cells.end();)
+            it = it->second.empty() ? cells.erase(it) : std::next(it);
+        emptyCells = 0;
+    }
+}
+
+void SpatialHash::move(u32 id, sf::Vector2f point) {
+    if (!contains(id))
+        return insert(id, point);
+
+    positions[id] = point;
+    u64 cellKey = key(cellOf(point));
+    if (cellKey == cellKeys[id])
+        return;
+
+    remove(id);
+    insert(id, point);
+}
+
+void SpatialHash::clear() {
+    cells.clear();
+    positions.clear();
+    cellKeys.clear();
+    bucketPositions.clear();
+    count = 0;
+    emptyCells = 0;
+}
+
+template<typename F>
+void SpatialHash::forEachCell(sf::FloatRect rect, F apply) const {
+    // An axis-aligned screen rect is a diamond in map space; visit the map-space
+    // bounding box of its corners and let callers filter exactly.
+    sf::Vector2f end = rect.position + rect.size;
+    sf::Vector2i corners[4] = {
+        cellOf(rect.position), cellOf(end), cellOf({ rect.position.x, end.y }), cellOf({ end.x, rect.position.y })
+    };
+
+    sf::Vector2i low = corners[0], high = corners[0];
+    for (const auto& corner: corners) {
+        low = { std::min(low.x, corner.x), std::min(low.y, corner.y) };
+        high = { std::max(high.x, corner.x), std::max(high.y, corner.y) };
+    }
+
+    // screenToMap truncates, so widen by a cell to cover rounding at the edges.
+    for (i32 y = low.y - 1; y <= high.y + 1; y++) {
+        for (i32 x = low.x - 1; x <= high.x + 1; x++) {
+            auto bucket = cells.find(key({ x, y }));
+            if (bucket != cells.end())
+                apply(bucket->second);
+        }
+    }
+}
+
+void SpatialHash::queryRadius(sf::Vector2f center, f32 radius, std::vector<u32>& ids) const {
+    sf::FloatRect area(center - sf::Vector2f(radius, radius), { radius * 2, radius * 2 });
+    forEachCell(area, [&](const std::vector<u32>& bucket) {
+        for (u32 id: bucket)
+            if ((positions[id] - center).lengthSquared() <= radius * radius)
+                ids.push_back(id);
+    });
+}
+
+void SpatialHash::queryRect(sf::FloatRect rect, std::vector<u32>& ids) const {
+    forEachCell(rect, [&](const std::vector<u32>& bucket) {
+        for (u32 id: bucket)
+            if (rect.contains(positions[id]))
+                ids.push_back(id);
+    });
+}
+
+void SpatialHash::overlapPairs(f32 distance, std::vector<std::pair<u32, u32>>& pairs) const {
+    f32 limit = distance * distance;
+
+    // Cells are diamonds; two points `ring` cells apart are at least `ring` times
+    // the diamond's width between opposite edges apart, which bounds the search.
+    sf::Vector2f half = level->tileSize.componentWiseDiv({ 2, 2 });
+    f32 width = 2 * half.x * half.y / std::sqrt(half.x * half.x + half.y * half.y);
+    i32 ring = (i32)std::ceil(distance / width);
+
+    auto test = [&](const std::vector<u32>& a, const std::vector<u32>& b) {
+        for (u32 first: a)
+            for (u32 second: b)
+                if ((positions[first] - positions[second]).lengthSquared() < limit)
+                    pairs.push_back({ std::min(first, second), std::max(first, second) });
+    };
+
+    for (const auto& [cellKey, bucket]: cells) {
+        if (bucket.empty())
+            continue;
+
+        for (usize i = 0; i < bucket.size(); i++)
+            for (usize j = i + 1; j < bucket.size(); j++)
+                if ((positions[bucket[i]] - positions[bucket[j]]).lengthSquared() < limit)
+                    pairs.push_back({ std::min(bucket[i], bucket[j]), std::max(bucket[i], bucket[j]) });
+
+        // Only the forward half of the neighborhood, so each cell pair is visited once.
+        sf::Vector2i cell((i32)(u32)(cellKey >> 32), (i32)(u32)cellKey);
+        for (i32 dy = 0; dy <= ring; dy++) {
+            for (i32 dx = dy == 0 ? 1 : -ring; dx <= ring; dx++) {
+                auto other = cells.find(key({ cell.x + dx, cell.y + dy }));
+                if (other != cells.end() && !other->second.empty())
+                    test(bucket, other->second);
+            }
+        }
+    }
+}
+
+// Map x runs down-right on screen and map y down-left; the move along each, in cells.
+static sf::Vector2f mapDelta(const SpatialHash& hash, sf::Vector2f delta) {
+    sf::Vector2f half = hash.level->tileSize.componentWiseDiv({ 2, 2 });
+    return { (delta.x / half.x + delta.y / half.y) / 2, (delta.y / half.y - delta.x / half.x) / 2 };
+}
+
+// One move of at most a cell along each map axis.
+static sf::Vector2f slideStep(const NavGrid& grid, const SpatialHash& hash, sf::Vector2f from, sf::Vector2f to) {
+    if (grid.isWalkable(hash.cellOf(to)))
+        return to;
+
+    // Slide along one map axis at a time.
+    sf::Vector2f half = hash.level->tileSize.componentWiseDiv({ 2, 2 });
+    sf::Vector2f along = mapDelta(hash, to - from);
+    sf::Vector2f stepX(along.x * half.x, along.x * half.y);
+    sf::Vector2f stepY(-along.y * half.x, along.y * half.y);
+
+    if (std::abs(along.x) >= std::abs(along.y)) {
+        if (grid.isWalkable(hash.cellOf(from + stepX))) return from + stepX;
+        if (grid.isWalkable(hash.cellOf(from + stepY))) return from + stepY;
+    } else {
+        if (grid.isWalkable(hash.cellOf(from + stepY))) return from + stepY;
+        if (grid.isWalkable(hash.cellOf(from + stepX))) return from + stepX;
+    }
+
+    return from;
+}
+
+sf::Vector2f resolveWalls(const NavGrid& grid, const SpatialHash& hash, sf::Vector2f from, sf::Vector2f to) {
+    sf::Vector2f along = mapDelta(hash, to - from);
+    u32 steps = std::max((u32)std::ceil(std::max(std::abs(along.x), std::abs(along.y))), 1u);
+    if (steps == 1)
+        return slideStep(grid, hash, from, to);
+
+    // Once a wall deflects the move, the rest continues from where it slid to.
+    sf::Vector2f step = (to - from) / (f32)steps;
+    sf::Vector2f position = from;
+    bool deflected = false;
+    for (u32 i = 0; i < steps; i++) {
+        sf::Vector2f target = i + 1 == steps && !deflected ? to : position + step;
+        sf::Vector2f next = slideStep(grid, hash, position, target);
+        if (next == position)
+            break;
+        deflected |= next != target;
+        position = next;
+    }
+    return position;
+}
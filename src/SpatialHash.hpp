@@ -0,0 +1,54 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+#include "Pathfinding.hpp"
+#include <unordered_map>
+
+// Uniform grid over map cells for broad-phase queries. Entities are points in
+// screen space (usually their feet), filed under the map cell they stand on.
+// Moving only re-files entities whose cell changed, and a query only visits
+// the cells its area covers, so nothing is O(n^2).
+struct SpatialHash
+{
+    static constexpr u32 absent = ~0u;
+
+    Level* level;
+    std::unordered_map<u64, std::vector<u32>> cells;
+    // Per entity id.
+    std::vector<sf::Vector2f> positions;
+    std::vector<u64> cellKeys;
+    std::vector<u32> bucketPositions;
+    usize count;
+    // Buckets left empty by remove(). They are kept so entities walking back and
+    // forth do not reallocate them, and swept once they outnumber the entities.
+    usize emptyCells;
+
+    SpatialHash() = delete;
+    SpatialHash(Level& level);
+
+    void insert(u32 id, sf::Vector2f point);
+    void remove(u32 id);
+    void move(u32 id, sf::Vector2f point);
+    bool contains(u32 id) const { return id < bucketPositions.size() && bucketPositions[id] != absent; }
+    void clear();
+
+    sf::Vector2i cellOf(sf::Vector2f point) const;
+
+    // Entities within `radius` of `center`, appended to `ids`.
+    void queryRadius(sf::Vector2f center, f32 radius, std::vector<u32>& ids) const;
+    // Entities inside the screen-space rect.
+    void queryRect(sf::FloatRect rect, std::vector<u32>& ids) const;
+    // Every pair (a < b) closer than `distance`.
+    void overlapPairs(f32 distance, std::vector<std::pair<u32, u32>>& pairs) const;
+
+    template<typename F>
+    void forEachCell(sf::FloatRect rect, F apply) const;
+
+    static u64 key(sf::Vector2i cell) { return (u64)(u32)cell.x << 32 | (u32)cell.y; }
+};
+
+// Moves a point from `from` towards `to` without entering blocked cells, sliding
+// along walls on the map axes when the direct move is blocked. Moves longer than
+// a cell are taken a cell at a time, so they cannot skip over a wall.
+sf::Vector2f resolveWalls(const NavGrid& grid, const SpatialHash& hash, sf::Vector2f from, sf::Vector2f to);
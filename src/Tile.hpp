@@ -0,0 +1,45 @@
+#pragma once
+
+#include "pch.hpp"
+
+enum TileType
+{
+    EMPTY = 0,
+    SPACE,
+    CENTER,
+    ROOM,
+    WALL_LEFT,
+    WALL_RIGHT,
+    WALL_UP,
+    WALL_DOWN,
+    WALL_CORNER_DOWN_LEFT,
+    WALL_CORNER_DOWN_RIGHT,
+    WALL_CORNER_UP_LEFT,
+    WALL_CORNER_UP_RIGHT,
+    WALL_JUNCTION_DOWN_RIGHT,
+    WALL_JUNCTION_DOWN_LEFT,
+    WALL_JUNCTION_UP_RIGHT,
+    WALL_JUNCTION_UP_LEFT,
+    ENTRANCE_LEFT,
+    ENTRANCE_RIGHT,
+    ENTRANCE_UP,
+    ENTRANCE_DOWN,
+    TILE_TYPE_COUNT,
+};
+
+enum TileFlags : u8
+{
+    TILE_NONE = 0,
+    TILE_HIGHLIGHTED = 1 << 0,
+};
+
+struct Tile
+{
+    sf::Vector2i point;
+    TileType type;
+
+    Tile(sf::Vector2i _point, TileType _type):
+        point(_point),
+        type(_type)
+    {}
+};
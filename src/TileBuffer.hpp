@@ -0,0 +1,65 @@
+#pragma once
+
+#include "pch.hpp"
+#include <memory>
+
+// Read-write view of a region of a memory-mapped file. Unmaps when the last
+// TileBuffer referencing it goes away.
+struct MappedFile
+{
+    void* address;
+    usize length;
+
+    MappedFile(void* _address, usize _length): address(_address), length(_length) {}
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+// Byte grid that either owns its memory or points straight into a mapped level
+// file. Mapped buffers are private copy-on-write pages, so edits never reach the
+// file; copying a buffer always produces an owned one.
+struct TileBuffer
+{
+    std::vector<u8> owned;
+    std::shared_ptr<MappedFile> mapping;
+    u8* ptr;
+    usize count;
+
+    TileBuffer(): ptr(nullptr), count(0) {}
+    TileBuffer(usize _count, u8 value): owned(_count, value), ptr(owned.data()), count(_count) {}
+    TileBuffer(std::shared_ptr<MappedFile> _mapping, u8* data, usize _count):
+        mapping(std::move(_mapping)), ptr(data), count(_count) {}
+
+    TileBuffer(const TileBuffer& other): owned(other.begin(), other.end()), ptr(owned.data()), count(other.count) {}
+    TileBuffer(TileBuffer&& other) noexcept:
+        owned(std::move(other.owned)), mapping(std::move(other.mapping)), ptr(other.ptr), count(other.count) {
+        other.ptr = nullptr;
+        other.count = 0;
+    }
+
+    TileBuffer& operator=(TileBuffer other) noexcept {
+        std::swap(owned, other.owned);
+        std::swap(mapping, other.mapping);
+        std::swap(ptr, other.ptr);
+        std::swap(count, other.count);
+        return *this;
+    }
+
+    u8& operator[](usize i) { return ptr[i]; }
+    u8 operator[](usize i) const { return ptr[i]; }
+
+    u8* data() { return ptr; }
+    const u8* data() const { return ptr; }
+    u8* begin() { return ptr; }
+    u8* end() { return ptr + count; }
+    const u8* begin() const { return ptr; }
+    const u8* end() const { return ptr + count; }
+    usize size() const { return count; }
+    bool empty() const { return count == 0; }
+    bool mapped() const { return mapping != nullptr; }
+
+    // Heap bytes only; mapped pages are accounted to the file.
+    usize capacity() const { return owned.capacity(); }
+};
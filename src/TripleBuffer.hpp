@@ -0,0 +1,48 @@
+#pragma once
+
+#include "pch.hpp"
+#include <atomic>
+
+// Single producer, single consumer handoff of the newest value without locks.
+// The writer fills back() and publishes it; the reader picks up whatever was
+// published last and never blocks the writer, so stale values are simply skipped.
+// The three slots are reused, so values with vectors keep their capacity.
+template <typename T>
+struct TripleBuffer
+{
+    static constexpr u8 indexMask = 3;
+    static constexpr u8 freshBit = 4;
+
+    T slots[3];
+    // Index of the slot between writer and reader, plus freshBit when it holds
+    // a value the reader has not taken yet.
+    std::atomic<u8> middle;
+    u8 backIndex;
+    u8 frontIndex;
+
+    TripleBuffer() = delete;
+    TripleBuffer(const T& initial):
+        slots{ initial, initial, initial },
+        middle(1),
+        backIndex(0),
+        frontIndex(2)
+    {}
+
+    T& back() { return slots[backIndex]; }
+    const T& front() const { return slots[frontIndex]; }
+
+    // Writer: hands back() to the reader and starts on a free slot.
+    void publish() {
+        backIndex = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel) & indexMask;
+    }
+
+    // Reader: moves the newest published value to front(). Returns false if
+    // nothing was published since the last call.
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & freshBit))
+            return false;
+
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & indexMask;
+        return true;
+    }
+};
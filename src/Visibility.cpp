@@ -0,0 +1,243 @@
+#include "Visibility.hpp"
+#include "Profiler.hpp"
+#include <atomic>
+#include <thread>
+
+// Transforms from octant-local (dx, dy) to map offsets, one row per octant.
+static const i32 octants[8][4] = {
+    { 1, 0, 0, 1 }, { 0, 1, 1, 0 }, { 0, -1, 1, 0 }, { -1, 0, 0, 1 },
+    { -1, 0, 0, -1 }, { 0, -1, -1, 0 }, { 0, 1, -1, 0 }, { 1, 0, 0, -1 }
+};
+
+struct Shadowcast
+{
+    const Visibility& visibility;
+    Viewer& viewer;
+    FovScratch& scratch;
+    i32 side;
+
+    void mark(sf::Vector2i cell) {
+        if (cell.x < 0 || cell.y < 0 || cell.x >= visibility.size.x || cell.y >= visibility.size.y)
+            return;
+
+        sf::Vector2i local = cell - viewer.cell + sf::Vector2i(viewer.radius, viewer.radius);
+        u32& stamp = scratch.stamps[(usize)local.y * side + local.x];
+        if (stamp == scratch.stamp)
+            return;
+
+        stamp = scratch.stamp;
+        viewer.next.push_back((u32)cell.y * visibility.size.x + cell.x);
+    }
+
+    // Scans rows `row` onwards of one octant between two slopes, recursing past
+    // each wall to light the part of the row the wall does not cover.
+    void cast(i32 row, f32 start, f32 end, const i32* transform) {
+        if (start < end)
+            return;
+
+        i32 radius = viewer.radius;
+        f32 nextStart = 0.f;
+        for (i32 j = row; j <= radius; j++) {
+            bool blocked = false;
+            for (i32 dx = -j, dy = -j; dx <= 0; dx++) {
+                f32 leftSlope = (dx - 0.5f) / (dy + 0.5f);
+                f32 rightSlope = (dx + 0.5f) / (dy - 0.5f);
+                if (start < rightSlope)
+                    continue;
+                if (end > leftSlope)
+                    break;
+
+                sf::Vector2i cell(viewer.cell.x + dx * transform[0] + dy * transform[1],
+                                  viewer.cell.y + dx * transform[2] + dy * transform[3]);
+                if (dx * dx + dy * dy <= radius * radius)
+                    mark(cell);
+
+                bool wall = visibility.isOpaque(cell);
+                if (blocked) {
+                    if (wall) {
+                        nextStart = rightSlope;
+                        continue;
+                    }
+                    blocked = false;
+                    start = nextStart;
+                } else if (wall && j < radius) {
+                    blocked = true;
+                    cast(j + 1, start, leftSlope, transform);
+                    nextStart = rightSlope;
+                }
+            }
+
+            if (blocked)
+                break;
+        }
+    }
+};
+
+void FovScratch::prepare(usize cells) {
+    if (stamps.size() < cells) {
+        stamps.assign(cells, 0);
+        stamp = 0;
+    }
+
+    if (++stamp == 0) {
+        std::fill(stamps.begin(), stamps.end(), 0);
+        stamp = 1;
+    }
+}
+
+Visibility::Visibility(const Level& level):
+    size(level.mapSize),
+    opaque(sf::IntRect({ 0, 0 }, level.mapSize)),
+    visible(sf::IntRect({ 0, 0 }, level.mapSize)),
+    explored(sf::IntRect({ 0, 0 }, level.mapSize)),
+    recomputed(0),
+    trackChanges(false)
+{
+    reset(level);
+}
+
+bool Visibility::blocksSight(TileType type) {
+    return type >= WALL_LEFT && type <= WALL_JUNCTION_UP_LEFT;
+}
+
+void Visibility::reset(const Level& level) {
+    size = level.mapSize;
+    opaque = Bitmap(sf::IntRect({ 0, 0 }, size));
+    visible = Bitmap(sf::IntRect({ 0, 0 }, size));
+    explored = Bitmap(sf::IntRect({ 0, 0 }, size));
+    viewerCounts.assign((usize)size.x * size.y, 0);
+    changedCells.clear();
+
+    for (i32 y = 0; y < size.y; y++) {
+        for (i32 x = 0; x < size.x; x++) {
+            i32 layer = level.topLayer({ x, y });
+            if (layer >= 0 && blocksSight(level.layers[layer].getType({ x, y })))
+                opaque.set({ x, y });
+        }
+    }
+
+    for (auto& viewer: viewers) {
+        viewer.cells.clear();
+        viewer.dirty = viewer.active;
+    }
+}
+
+void Visibility::tileChanged(const Level& level, sf::Vector2i cell) {
+    if (!level.contains(cell))
+        return;
+
+    i32 layer = level.topLayer(cell);
+    bool blocks = layer >= 0 && blocksSight(level.layers[layer].getType(cell));
+    if (blocks == opaque.get(cell))
+        return;
+
+    opaque.set(cell, blocks);
+    for (auto& viewer: viewers) {
+        sf::Vector2i offset = cell - viewer.cell;
+        if (viewer.active && std::max(std::abs(offset.x), std::abs(offset.y)) <= viewer.radius)
+            viewer.dirty = true;
+    }
+}
+
+void Visibility::setViewer(u32 id, sf::Vector2i cell, i32 radius) {
+    if (id >= viewers.size())
+        viewers.resize(id + 1);
+
+    Viewer& viewer = viewers[id];
+    if (viewer.active && viewer.cell == cell && viewer.radius == radius)
+        return;
+
+    viewer.cell = cell;
+    viewer.radius = radius;
+    viewer.active = true;
+    viewer.dirty = true;
+}
+
+void Visibility::removeViewer(u32 id) {
+    if (id >= viewers.size() || !viewers[id].active)
+        return;
+
+    Viewer& viewer = viewers[id];
+    viewer.next.clear();
+    apply(viewer);
+    viewer.active = false;
+    viewer.dirty = false;
+}
+
+u32 Visibility::update(u32 threads) {
+    PROFILE_SCOPE("Visibility::update");
+    std::vector<u32> dirty;
+    for (u32 i = 0; i < viewers.size(); i++)
+        if (viewers[i].dirty)
+            dirty.push_back(i);
+    if (dirty.empty())
+        return 0;
+
+    // Threads are started and joined on every call, like findPaths; that only
+    // pays off once there are plenty of viewers to share.
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::min<u32>(threads, (dirty.size() + 63) / 64);
+    if (scratch.size() < threads)
+        scratch.resize(threads);
+
+    if (threads == 1) {
+        for (u32 id: dirty)
+            computeFov(viewers[id], scratch[0]);
+    } else {
+        std::atomic<u32> next(0);
+        std::vector<std::thread> workers;
+        for (u32 t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                for (u32 i; (i = next.fetch_add(1)) < dirty.size();)
+                    computeFov(viewers[dirty[i]], scratch[t]);
+            });
+        }
+        for (auto& worker: workers)
+            worker.join();
+    }
+
+    for (u32 id: dirty)
+        apply(viewers[id]);
+    recomputed += dirty.size();
+    return dirty.size();
+}
+
+void Visibility::computeFov(Viewer& viewer, FovScratch& fovScratch) const {
+    i32 side = 2 * viewer.radius + 1;
+    fovScratch.prepare((usize)side * side);
+    viewer.next.clear();
+
+    Shadowcast shadowcast { *this, viewer, fovScratch, side };
+    shadowcast.mark(viewer.cell);
+    for (const auto& transform: octants)
+        shadowcast.cast(1, 1.f, 0.f, transform);
+}
+
+void Visibility::apply(Viewer& viewer) {
+    // Add before withdrawing, so cells seen both before and after never flip.
+    for (u32 offset: viewer.next) {
+        if (viewerCounts[offset]++ != 0)
+            continue;
+
+        sf::Vector2i cell(offset % size.x, offset / size.x);
+        visible.set(cell);
+        explored.set(cell);
+        if (trackChanges)
+            changedCells.push_back(cell);
+    }
+
+    for (u32 offset: viewer.cells) {
+        if (--viewerCounts[offset] != 0)
+            continue;
+
+        sf::Vector2i cell(offset % size.x, offset / size.x);
+        visible.set(cell, false);
+        if (trackChanges)
+            changedCells.push_back(cell);
+    }
+
+    viewer.cells.swap(viewer.next);
+    viewer.next.clear();
+    viewer.dirty = false;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+
+// Per-thread dedupe for one viewer's cells, over the square its radius covers.
+struct FovScratch
+{
+    std::vector<u32> stamps;
+    u32 stamp = 0;
+
+    void prepare(usize cells);
+};
+
+struct Viewer
+{
+    sf::Vector2i cell;
+    i32 radius = 0;
+    bool active = false;
+    bool dirty = false;
+    // Map cell offsets the viewer sees, as last applied, and as just computed.
+    std::vector<u32> cells;
+    std::vector<u32> next;
+};
+
+// Field of view for any number of viewers by recursive shadowcasting against
+// walls. Two packed layers are kept over the map: `visible`, what some viewer
+// sees now, and `explored`, everything seen since the level was loaded.
+// A viewer is only recomputed after it enters another cell or a tile within its
+// radius changes opacity. Cells count the viewers seeing them, so a viewer's
+// old cells are withdrawn without recomputing anyone else.
+struct Visibility
+{
+    sf::Vector2i size;
+    Bitmap opaque;
+    Bitmap visible;
+    Bitmap explored;
+    std::vector<u32> viewerCounts;
+    std::vector<Viewer> viewers;
+    std::vector<FovScratch> scratch;
+    u64 recomputed;
+
+    // When set, cells whose visible bit flipped are appended to changedCells
+    // for a renderer to patch; the consumer clears it.
+    bool trackChanges;
+    std::vector<sf::Vector2i> changedCells;
+
+    Visibility() = delete;
+    Visibility(const Level& level);
+
+    static bool blocksSight(TileType type);
+
+    // Starts over on a new level: nothing explored, every viewer recomputed.
+    void reset(const Level& level);
+    // Re-reads a cell after an edit and marks the viewers in range of it.
+    void tileChanged(const Level& level, sf::Vector2i cell);
+
+    void setViewer(u32 id, sf::Vector2i cell, i32 radius);
+    void removeViewer(u32 id);
+
+    // Recomputes viewers that need it, spread over `threads` threads (0 = all
+    // cores) started for this call, then applies the results. Returns how many
+    // were recomputed.
+    u32 update(u32 threads = 0);
+
+    bool isOpaque(sf::Vector2i cell) const {
+        return cell.x < 0 || cell.y < 0 || cell.x >= size.x || cell.y >= size.y || opaque.get(cell);
+    }
+    bool isVisible(sf::Vector2i cell) const { return visible.get(cell); }
+    bool isExplored(sf::Vector2i cell) const { return explored.get(cell); }
+    Fog fog() const { return Fog { explored, visible }; }
+
+    void computeFov(Viewer& viewer, FovScratch& scratch) const;
+    void apply(Viewer& viewer);
+};
@@ -0,0 +1,44 @@
+#include "WindowInput.hpp"
+#include "Profiler.hpp"
+
+WindowInput::WindowInput(sf::RenderWindow& _window):
+    window(_window)
+{}
+
+bool WindowInput::poll(InputState& input) {
+    PROFILE_SCOPE("Game::pollEvents");
+    input.events.clear();
+    input.pan = { 0.f, 0.f };
+
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Scan::A)) input.pan.x = -1;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Scan::D)) input.pan.x = 1;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Scan::W)) input.pan.y = -1;
+    if (sf::Keyboard::isKeyPressed(sf::Keyboard::Scan::S)) input.pan.y = 1;
+
+    input.pointer = window.mapPixelToCoords(sf::Mouse::getPosition(window));
+
+    while (const std::optional event = window.pollEvent()) {
+        if (event->is<sf::Event::Closed>()) {
+            input.events.push_back({ ACTION_QUIT, 0.f });
+        } else if (const auto* keyPressed = event->getIf<sf::Event::KeyPressed>()) {
+            switch (keyPressed->scancode) {
+                case sf::Keyboard::Scancode::Escape:    input.events.push_back({ ACTION_QUIT, 0.f });             break;
+                case sf::Keyboard::Scancode::R:         input.events.push_back({ ACTION_REGENERATE, 0.f });       break;
+                case sf::Keyboard::Scancode::F5:        input.events.push_back({ ACTION_SAVE, 0.f });             break;
+                case sf::Keyboard::Scancode::F9:        input.events.push_back({ ACTION_LOAD, 0.f });             break;
+                case sf::Keyboard::Scancode::F3:        input.events.push_back({ ACTION_TOGGLE_PROFILER, 0.f });  break;
+                case sf::Keyboard::Scancode::F12:       input.events.push_back({ ACTION_WRITE_TRACE, 0.f });      break;
+                default:                                                                                          break;
+            }
+        } else if (const auto* scroll = event->getIf<sf::Event::MouseWheelScrolled>()) {
+            input.events.push_back({ ACTION_ZOOM, scroll->delta });
+        } else if (const auto* mouseButtonPressed = event->getIf<sf::Event::MouseButtonPressed>()) {
+            if (mouseButtonPressed->button == sf::Mouse::Button::Left)
+                input.events.push_back({ ACTION_SELECT, 0.f });
+            else if (mouseButtonPressed->button == sf::Mouse::Button::Right)
+                input.events.push_back({ ACTION_TOGGLE_WALL, 0.f });
+        }
+    }
+
+    return true;
+}
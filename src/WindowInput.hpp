@@ -0,0 +1,15 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Input.hpp"
+
+// Reads keyboard, mouse and window events from a live window.
+struct WindowInput : public InputSource
+{
+    sf::RenderWindow& window;
+
+    WindowInput() = delete;
+    WindowInput(sf::RenderWindow& window);
+
+    virtual bool poll(InputState& input);
+};
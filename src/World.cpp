@@ -0,0 +1,197 @@
+#include "World.hpp"
+#include "Profiler.hpp"
+
+static constexpr i32 regionOffset = World::chunkSize / 2;
+
+WorldChunk::WorldChunk(sf::Vector2i _coord, const Level& prototype):
+    coord(_coord),
+    level(prototype),
+    bytes(0),
+    lastSeen(0)
+{
+    level.mapSize = { World::chunkSize, World::chunkSize };
+    offset = level.mapToScreen(coord * World::chunkSize);
+}
+
+World::World(u64 _seed, const Level& _prototype, usize _memoryBudget, u32 threads):
+    seed(_seed),
+    prototype(_prototype),
+    memoryBudget(_memoryBudget),
+    memoryUsed(0),
+    chunksGenerated(0),
+    frame(0),
+    quit(false)
+{
+    prototype.layers.clear();
+    prototype.rooms.clear();
+    prototype.mapSize = { chunkSize, chunkSize };
+    // Regions have no center area; park it outside the grid.
+    prototype.center = sf::IntRect({ -chunkSize, -chunkSize }, { 0, 0 });
+
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency() / 2, 1u);
+    for (u32 i = 0; i < threads; i++)
+        workers.emplace_back(&World::run, this);
+}
+
+World::~World() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    for (auto& worker: workers)
+        worker.join();
+}
+
+std::vector<Room> World::regionRooms(sf::Vector2i region) const {
+    Level level(prototype);
+    Rng rng(seed ^ (u64)(u32)region.x * 0x9E3779B97F4A7C15ull ^ (u64)(u32)region.y * 0xC2B2AE3D27D4EB4Full);
+    return level.generateRooms(rng);
+}
+
+std::unique_ptr<WorldChunk> World::generateChunk(sf::Vector2i coord) const {
+    PROFILE_SCOPE("World::generateChunk");
+    auto chunk = std::make_unique<WorldChunk>(coord, prototype);
+    Level& level = chunk->level;
+    level.seed = seed;
+
+    Layer groundLayer(level.mapSize);
+    std::fill(groundLayer.types.begin(), groundLayer.types.end(), SPACE);
+
+    Layer roomLayer(level.mapSize);
+    sf::Vector2i origin = coord * chunkSize;
+    for (i32 ry = coord.y - 1; ry <= coord.y; ry++) {
+        for (i32 rx = coord.x - 1; rx <= coord.x; rx++) {
+            sf::Vector2i shift = sf::Vector2i(rx, ry) * chunkSize + sf::Vector2i(regionOffset, regionOffset) - origin;
+            for (const auto& room: regionRooms({ rx, ry })) {
+                for (const auto& tile: room.tiles) {
+                    sf::Vector2i cell = tile.point + shift;
+                    if (cell.x >= 0 && cell.x < chunkSize && cell.y >= 0 && cell.y < chunkSize)
+                        roomLayer.setType(cell, tile.type);
+                }
+            }
+        }
+    }
+
+    level.layers.push_back(std::move(groundLayer));
+    level.layers.push_back(std::move(roomLayer));
+
+    chunk->vertices.resize(level.layers.size());
+    chunk->bytes = sizeof(WorldChunk) + level.memoryUsage();
+    for (usize i = 0; i < level.layers.size(); i++) {
+        level.appendQuads(level.layers[i], sf::IntRect({ 0, 0 }, level.mapSize), chunk->vertices[i]);
+        chunk->bytes += chunk->vertices[i].capacity() * sizeof(sf::Vertex);
+    }
+
+    return chunk;
+}
+
+std::vector<const WorldChunk*> World::update(sf::FloatRect screen) {
+    PROFILE_SCOPE("World::update");
+    std::vector<const WorldChunk*> visible;
+    std::vector<sf::Vector2i> missing;
+    frame++;
+
+    // Same culling as LevelRenderer, without clamping to a map, plus one chunk
+    // of margin so generation starts before a chunk scrolls into view.
+    MapBounds bounds = prototype.visibleBounds(screen);
+    MapBounds wanted { bounds.minDiff - chunkSize, bounds.maxDiff + chunkSize, bounds.minSum - chunkSize, bounds.maxSum + chunkSize };
+    sf::Vector2i rows = wanted.rows();
+    auto floorDiv = [](i32 value) { return value >= 0 ? value / chunkSize : (value - chunkSize + 1) / chunkSize; };
+
+    for (i32 cy = floorDiv(rows.x); cy <= floorDiv(rows.y); cy++) {
+        sf::Vector2i columns = wanted.columns(cy * chunkSize, cy * chunkSize + chunkSize - 1);
+        for (i32 cx = floorDiv(columns.x); columns.x <= columns.y && cx <= floorDiv(columns.y); cx++) {
+            sf::IntRect rect({ cx * chunkSize, cy * chunkSize }, { chunkSize, chunkSize });
+            if (!wanted.intersects(rect))
+                continue;
+
+            auto found = index.find(key({ cx, cy }));
+            if (found == index.end()) {
+                missing.emplace_back(cx, cy);
+                continue;
+            }
+
+            // The margin counts as wanted too, or it would be evicted and
+            // generated again every frame once the view fills the budget.
+            WorldChunk& chunk = **found->second;
+            chunk.lastSeen = frame;
+            chunks.splice(chunks.begin(), chunks, found->second);
+            if (bounds.intersects(rect))
+                visible.push_back(&chunk);
+        }
+    }
+
+    // Nearest chunks go last so workers pop them first.
+    sf::Vector2f center = screen.position + screen.size / 2.f;
+    sf::Vector2i centerCell = prototype.screenToMap(center);
+    sf::Vector2i centerChunk(floorDiv(centerCell.x), floorDiv(centerCell.y));
+    auto distance = [&](sf::Vector2i coord) { return std::abs(coord.x - centerChunk.x) + std::abs(coord.y - centerChunk.y); };
+    std::sort(missing.begin(), missing.end(), [&](sf::Vector2i a, sf::Vector2i b) { return distance(a) > distance(b); });
+
+    std::vector<std::unique_ptr<WorldChunk>> adopted;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.clear();
+        for (const auto& coord: missing)
+            if (!inFlight.count(key(coord)))
+                queue.push_back(coord);
+        adopted.swap(finished);
+    }
+    if (!queue.empty())
+        wake.notify_all();
+
+    for (auto& chunk: adopted) {
+        u64 chunkKey = key(chunk->coord);
+        if (index.count(chunkKey))
+            continue;
+
+        // Just requested, so it counts as wanted until the next update says otherwise.
+        memoryUsed += chunk->bytes;
+        chunksGenerated++;
+        chunk->lastSeen = frame;
+        chunks.push_front(std::move(chunk));
+        index[chunkKey] = chunks.begin();
+    }
+
+    // Evict from the cold end, but never what this frame wants: everything
+    // stamped this frame sits in front of the older chunks.
+    while (memoryUsed > memoryBudget && !chunks.empty() && chunks.back()->lastSeen != frame) {
+        WorldChunk& chunk = *chunks.back();
+        memoryUsed -= chunk.bytes;
+        index.erase(key(chunk.coord));
+        chunks.pop_back();
+    }
+
+    std::sort(visible.begin(), visible.end(), [](const WorldChunk* a, const WorldChunk* b) {
+        return a->coord.x + a->coord.y < b->coord.x + b->coord.y;
+    });
+    return visible;
+}
+
+usize World::pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size() + inFlight.size() + finished.size();
+}
+
+void World::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+        wake.wait(lock, [this]() { return quit || !queue.empty(); });
+        if (quit)
+            return;
+
+        sf::Vector2i coord = queue.back();
+        queue.pop_back();
+        inFlight.insert(key(coord));
+        lock.unlock();
+
+        std::unique_ptr<WorldChunk> chunk = generateChunk(coord);
+
+        lock.lock();
+        inFlight.erase(key(coord));
+        finished.push_back(std::move(chunk));
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "pch.hpp"
+#include "Level.hpp"
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+// One generated piece of the endless world. It is a small Level of its own, so
+// autotiling and quad building work unchanged; quads are in chunk-local screen
+// space and get translated by `offset` when drawn.
+struct WorldChunk
+{
+    sf::Vector2i coord;
+    sf::Vector2f offset;
+    Level level;
+    std::vector<std::vector<sf::Vertex>> vertices;
+    usize bytes;
+    // World::frame of the last update that wanted this chunk.
+    u64 lastSeen;
+
+    WorldChunk() = delete;
+    WorldChunk(sf::Vector2i coord, const Level& prototype);
+};
+
+// Endless map streamed in fixed-size chunks around the view. Chunks are a pure
+// function of the world seed and their coordinates, generated by background
+// workers and kept in an LRU cache under a memory budget.
+//
+// Rooms are placed per region, on a grid offset by half a chunk from the chunk
+// grid, and never leave their region. Every chunk overlaps four regions and
+// stamps in the parts of their rooms that fall inside it, so a room split
+// across chunk borders comes out the same whichever chunk is built first.
+struct World
+{
+    static constexpr i32 chunkSize = 64;
+
+    using ChunkList = std::list<std::unique_ptr<WorldChunk>>;
+
+    u64 seed;
+    Level prototype;
+    usize memoryBudget;
+    usize memoryUsed;
+    u64 chunksGenerated;
+    u64 frame;
+
+    // Resident chunks, most recently wanted first.
+    ChunkList chunks;
+    std::unordered_map<u64, ChunkList::iterator> index;
+
+    // Missing chunks the view wants, nearest last; rebuilt on every update so
+    // chunks the view has left are never started.
+    std::vector<sf::Vector2i> queue;
+    std::unordered_set<u64> inFlight;
+    std::vector<std::unique_ptr<WorldChunk>> finished;
+    bool quit;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::thread> workers;
+
+    World() = delete;
+    // `prototype` gives tile sizes and the room budget of one region.
+    World(u64 seed, const Level& prototype, usize memoryBudget, u32 threads = 0);
+    ~World();
+
+    // Requests the chunks around `screen`, adopts finished ones and evicts the
+    // least recently used beyond the budget. Chunks the view wants this frame
+    // are never evicted, so the budget is exceeded while the view needs more.
+    // Returns the resident chunks that are visible, back to front. Never waits
+    // on generation.
+    std::vector<const WorldChunk*> update(sf::FloatRect screen);
+    usize pending();
+
+    std::unique_ptr<WorldChunk> generateChunk(sf::Vector2i coord) const;
+    std::vector<Room> regionRooms(sf::Vector2i region) const;
+    void run();
+
+    static u64 key(sf::Vector2i coord) { return (u64)(u32)coord.x << 32 | (u32)coord.y; }
+};
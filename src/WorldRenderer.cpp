@@ -0,0 +1,32 @@
+#include "WorldRenderer.hpp"
+#include "Profiler.hpp"
+
+WorldRenderer::WorldRenderer(World& _world, const sf::Texture& _tileset):
+    world(_world),
+    tileset(&_tileset)
+{}
+
+void WorldRenderer::draw(sf::RenderTarget& target, sf::RenderStates states) const {
+    PROFILE_SCOPE("World::draw");
+    states.texture = tileset;
+
+    const sf::View& view = target.getView();
+    std::vector<const WorldChunk*> visible = world.update(sf::FloatRect(view.getCenter() - view.getSize() / 2.f, view.getSize()));
+
+    // Ground first everywhere, then walls chunk by chunk back to front. Chunks
+    // sharing a border only overlap on rows ordered the same way.
+    for (usize layer = 0; layer < 2; layer++) {
+        for (const WorldChunk* chunk: visible) {
+            if (layer >= chunk->vertices.size() || chunk->vertices[layer].empty())
+                continue;
+
+            sf::RenderStates chunkStates(states);
+            chunkStates.transform.translate(chunk->offset);
+            const std::vector<sf::Vertex>& vertices = chunk->vertices[layer];
+            target.draw(vertices.data(), vertices.size(), sf::PrimitiveType::Triangles, chunkStates);
+            stats.drawCalls++;
+            stats.quads += vertices.size() / 6;
+        }
+    }
+    stats.chunksDrawn += visible.size();
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "pch.hpp"
+#include "World.hpp"
+#include "LevelRenderer.hpp"
+
+// Draws the streamed world. Streaming is driven from here because the view is
+// only known at draw time; chunks still being generated are simply skipped.
+struct WorldRenderer : public sf::Drawable
+{
+    World& world;
+    const sf::Texture* tileset;
+    mutable RenderStats stats;
+
+    WorldRenderer() = delete;
+    WorldRenderer(World& world, const sf::Texture& tileset);
+
+    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+};
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "pch.hpp"
 
 inline void printVector2i(std::string prefix, sf::Vector2i vec)
@@ -16,3 +18,13 @@ inline void printIntRect(std::string prefix, sf::IntRect rect)
     i32 bottom = rect.position.y + rect.size.y;
     printf("%s: %d-%d, %d-%d\n", prefix.c_str(), rect.position.x, right, rect.position.y, bottom);
 }
+
+inline sf::IntRect boundingRect(sf::IntRect a, sf::IntRect b)
+{
+    sf::Vector2i start(std::min(a.position.x, b.position.x), std::min(a.position.y, b.position.y));
+    sf::Vector2i end(
+        std::max(a.position.x + a.size.x, b.position.x + b.size.x),
+        std::max(a.position.y + a.size.y, b.position.y + b.size.y)
+    );
+    return sf::IntRect(start, end - start);
+}
@@ -1,7 +1,18 @@
 #include "Game.hpp"
+#include "Headless.hpp"
+#include <cstring>
 
-int main()
+int main(int argc, char** argv)
 {
-    Game game(1280, 800);
+    if (argc > 1 && !std::strcmp(argv[1], "--headless"))
+        return runHeadless(argc - 2, argv + 2);
+
+    if (argc > 2 && !std::strcmp(argv[1], "--replay")) {
+        Game game(1280, 800, nullptr, argv[2]);
+        game.run();
+        return 0;
+    }
+
+    Game game(1280, 800, argc > 1 ? argv[1] : nullptr);
     game.run();
-}
\ No newline at end of file
+}
@@ -2,6 +2,8 @@
 #include <SFML/System.hpp>
 #include <SFML/Window.hpp>
 #include <vector>
+#include <algorithm>
+#include <functional>
 #include <unordered_set>
 #include <cstdlib>
 #include <ctime>
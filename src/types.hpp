@@ -12,5 +12,7 @@ using i32 = std::int32_t;
 using i16 = std::int16_t;
 using i8 = std::int8_t;
 
+using usize = std::size_t;
+
 using f32 = float;
 using f64 = double;